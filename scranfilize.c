@@ -25,25 +25,93 @@ const char * usage =
 "\n"
 "   --force    force to overwrite existing file\n"
 "\n"
+"   --shards <k>   write '<scrambled-cnf>.<shard>' files in parallel\n"
+"                  balanced by literals plus a '.manifest' file\n"
+"\n"
+"   --maps <prefix> dump clause store and maps as raw arrays\n"
+"                  (for zero-copy access with 'numpy.memmap')\n"
+"\n"
+"   --gbd-hash     compute GBD instance hashes of original and scrambled\n"
+"                  CNF while parsing and printing\n"
+"\n"
+"   --frames <k>   write '.zst', '.xz' or '.gz' output compressed in 'k'\n"
+"                  independent frames listed in '<scrambled-cnf>.index'\n"
+"\n"
+"   --trace <file> write Chrome trace / Perfetto JSON of all stages\n"
+"\n"
+"   --tune         calibrate buffer sizes on this host and save profile\n"
+"                  (in the directory of the only or '<scrambled-cnf>' path)\n"
+"   --no-profile   ignore saved profile ('$SCRANFILIZE_PROFILE' or\n"
+"                  '$HOME/.scranfilize-profile' by default)\n"
+"\n"
+"   --literal-table     always format through pre-rendered literals\n"
+"   --no-literal-table  never use pre-rendered literals\n"
+"                       (default is to use them if variables occur\n"
+"                       on average at least 16 times)\n"
+"\n"
+"   --lazy         compute variable map lazily in cached blocks\n"
+"                  (needs move window, gives different scramble)\n"
+"\n"
+"   --range <a>:<b>  only print clauses at output positions 'a' to 'b'\n"
+"                    (exclusive) and the header only if 'a' is zero\n"
+"                    (requires '-s <seed>' shared by all ranges)\n"
+"\n"
+"   --cache-window <MB>  keep at most about that much of input and\n"
+"                        output files in the page cache\n"
+"   --direct             write output files with 'O_DIRECT'\n"
+"\n"
+"   --search <cmd>   pipe scrambles of several seeds to solver '<cmd>'\n"
+"                    and write the fastest and slowest scramble to\n"
+"                    '<scrambled-cnf>.fastest' and '.slowest' and\n"
+"                    all timings to '<scrambled-cnf>.seeds' (solver\n"
+"                    exit codes other than 0, 10 and 20 are failures)\n"
+"   --seeds <n>      number of seeds searched (default 16)\n"
+"   --timeout <sec>  solver time limit while searching (default 60)\n"
+"\n"
+"   --hugetlb        map large arrays from explicit huge page pool\n"
+"   --no-huge-pages  do not advise transparent huge pages\n"
+"\n"
+"   --blocked-remap     always map literals in cache-sized blocks\n"
+"   --no-blocked-remap  never map literals in blocks (default is to\n"
+"                       use blocks for more than 4M variables unless\n"
+"                       pre-rendered literals are used)\n"
+"\n"
+"   --trust-input  use fast tokenizer without inline syntax checks\n"
+"                  (range and character checks are deferred)\n"
+"   --no-validate  skip even deferred checks (needs '--trust-input')\n"
+"\n"
 "by default the original CNF is read from '<stdin>' unless '<original-cnf>'\n"
 "is given.  The scrambled CNF is written to '<stdout>' or '<scrambled-cnf>'.\n"
+"Weighted MaxSAT instances in 'p wcnf' or new-style WCNF format (with 'h'\n"
+"marking hard clauses) are scrambled too and their weights are kept.\n"
+"For QDIMACS input variables are only moved within their quantifier block.\n"
+"XOR constraints ('x' lines) are permuted with the clauses and flipping a\n"
+"variable in an XOR constraint toggles its parity.\n"
 ;
 
 /*------------------------------------------------------------------------*/
 
+#define _GNU_SOURCE                     // For 'O_DIRECT' etc.
+
 #include <assert.h>
 #include <ctype.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
 #include <math.h>
 #include <stdarg.h>
+#include <signal.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/times.h>
+#include <time.h>
 #include <sys/types.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 /*------------------------------------------------------------------------*/
@@ -64,6 +132,33 @@ static double variable_move_window = -1;
 static double clause_move_window = -1;
 static bool absolute_windows = false;
 static bool force = false;
+static int num_shards = 0;
+static int num_frames = 0;
+static const char * trace_path = 0;
+static const char * maps_prefix = 0;
+static bool tune = false;
+static bool use_profile = true;
+static int literal_table = -1;          // Negative means automatic.
+static int blocked_remap = -1;          // Negative means automatic.
+static bool lazy = false;
+static int huge_pages = 1;              // One transparent, two explicit.
+static int range_begin = -1, range_end;   // Negative means all clauses.
+static size_t cache_window = 0;         // Zero means unrestricted.
+static bool direct_output = false;
+static const char * search_command = 0;
+static int num_seeds = 16;
+static double search_timeout = 60;
+static bool gbd_hash = false;
+static bool trust_input = false;
+static bool validate = true;
+
+/*------------------------------------------------------------------------*/
+
+// Tunable parameters (defaults are overwritten by the profile).
+
+static size_t read_buffer_size = 0;             // Zero is 'stdio' default.
+static size_t write_buffer_size = 1 << 16;
+static int max_processes = 0;           // Zero means all available CPUs.
 
 /*------------------------------------------------------------------------*/
 
@@ -71,7 +166,52 @@ static bool force = false;
 
 static int max_var;
 static int num_clauses;
-static int ** clauses;
+static int size_clauses;
+
+// Clause store.  Binary and ternary clauses are kept in the fixed-width
+// arrays 'binaries' and 'ternaries'.  All other clauses, as well as XOR
+// constraints, are kept zero terminated in 'arena'.  The clauses in input
+// order are given by tagged references, where the two least significant
+// bits give the kind of the clause and the remaining bits its offset in
+// the corresponding array.  This avoids one allocation per clause and
+// allows specialized remapping and formatting for the short clauses.
+
+typedef uint64_t Ref;
+
+enum {
+  LONG_CLAUSE = 0, BINARY_CLAUSE = 1, TERNARY_CLAUSE = 2, XOR_CLAUSE = 3
+};
+
+static Ref * clauses;
+static int * binaries, * ternaries, * arena;
+static size_t num_binaries, size_binaries;
+static size_t num_ternaries, size_ternaries;
+static size_t num_arena, size_arena;
+
+// Weighted MaxSAT ('p wcnf' or new-style WCNF without header).
+
+static bool weighted;
+static bool new_wcnf;
+static uint64_t top_weight;
+static uint64_t * weights;            // Zero marks new-style hard clauses.
+
+// XOR constraints ('x' lines as in CryptoMiniSat) are stored in the same
+// clause store and tagged as 'XOR_CLAUSE'.
+
+static int num_xors;
+
+// Quantifier prefix (QDIMACS).  The variables of all blocks are stored
+// consecutively in 'prefix'.  Free variables are collected in an extra
+// outermost block of type 'FREE' which is not printed.
+
+enum { FREE = 0 };
+
+typedef struct Block { int type, start, size; } Block;
+
+static int num_blocks, size_blocks;
+static Block * blocks;
+static int num_prefix, size_prefix;
+static int * prefix;
 
 /*------------------------------------------------------------------------*/
 
@@ -107,6 +247,338 @@ static void msg (const char * msg, ...) {
 
 /*------------------------------------------------------------------------*/
 
+// Huge pages.  The clause store, the maps and the rank records are large
+// and accessed randomly while scrambling and printing, which causes many
+// TLB misses.  Allocations of at least 2 MB are aligned to 2 MB and
+// advised to be backed by transparent huge pages.  With '--hugetlb' they
+// are mapped from the explicit huge page pool instead, falling back to
+// transparent huge pages if the pool is exhausted.  These mappings are
+// recorded in 'huge_maps' since they have to be released by 'munmap'.
+
+#define HUGE_PAGE (1ul << 21)
+#define HUGE_MAPS 64
+
+typedef struct Huge { void * ptr; size_t bytes; } Huge;
+
+static Huge huge_maps[HUGE_MAPS];
+static int num_huge_maps;
+static uint64_t huge_advised, huge_mapped;
+static bool huge_warned;
+
+static size_t huge_round (size_t bytes) {
+  return (bytes + HUGE_PAGE - 1) & ~(HUGE_PAGE - 1);
+}
+
+static Huge * find_huge (void * ptr) {
+  for (Huge * h = huge_maps; h < huge_maps + num_huge_maps; h++)
+    if (h->ptr == ptr) return h;
+  return 0;
+}
+
+static void * huge_alloc (size_t bytes) {
+  if (!huge_pages || bytes < HUGE_PAGE) return malloc (bytes);
+  const size_t rounded = huge_round (bytes);
+#ifdef MAP_HUGETLB
+  if (huge_pages > 1 && num_huge_maps < HUGE_MAPS) {
+    void * res = mmap (0, rounded, PROT_READ | PROT_WRITE,
+      MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+    if (res != MAP_FAILED) {
+      Huge * h = huge_maps + num_huge_maps++;
+      h->ptr = res, h->bytes = rounded;
+      huge_mapped += rounded;
+      return res;
+    }
+    if (!huge_warned)
+      msg ("explicit huge pages unavailable (using transparent ones)");
+    huge_warned = true;
+  }
+#endif
+  void * res;
+  if (posix_memalign (&res, HUGE_PAGE, rounded)) return 0;
+#ifdef MADV_HUGEPAGE
+  if (!madvise (res, rounded, MADV_HUGEPAGE)) huge_advised += rounded;
+#endif
+  return res;
+}
+
+static void huge_free (void * ptr) {
+  Huge * h = find_huge (ptr);
+  if (!h) { free (ptr); return; }
+  munmap (h->ptr, h->bytes);
+  *h = huge_maps[--num_huge_maps];
+}
+
+// Same as 'realloc' but needs the old size to move huge allocations.
+
+static void * huge_realloc (void * ptr, size_t old_bytes, size_t bytes) {
+  if (!ptr) return huge_alloc (bytes);
+  Huge * h = find_huge (ptr);
+  if (h && bytes <= h->bytes) return ptr;
+  if (!h && (!huge_pages || bytes < HUGE_PAGE))
+    return realloc (ptr, bytes);
+  void * res = huge_alloc (bytes);
+  if (res) memcpy (res, ptr, old_bytes), huge_free (ptr);
+  return res;
+}
+
+// Report huge page usage as seen by the kernel (in kilobytes).
+
+static void huge_stats () {
+  if (!huge_advised && !huge_mapped) return;
+  FILE * file = fopen ("/proc/self/smaps_rollup", "r");
+  uint64_t anonymous = 0, hugetlb = 0;
+  if (file) {
+    char line[128];
+    uint64_t kb;
+    while (fgets (line, sizeof line, file))
+      if (sscanf (line, "AnonHugePages: %" SCNu64, &kb) == 1)
+	anonymous = kb;
+      else if (sscanf (line, "Private_Hugetlb: %" SCNu64, &kb) == 1)
+	hugetlb = kb;
+    fclose (file);
+  }
+  msg ("advised %" PRIu64 " MB for transparent huge pages "
+       "(%" PRIu64 " MB backed)", huge_advised >> 20, anonymous >> 10);
+  if (huge_pages > 1)
+    msg ("mapped %" PRIu64 " MB of explicit huge pages "
+         "(%" PRIu64 " MB backed)", huge_mapped >> 20, hugetlb >> 10);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Trace recording ('--trace <file>').  Each process (the main process and
+// every shard writer) records complete span events into its own ring
+// buffer, which lives in shared memory such that forked children can
+// report back.  If a ring overflows only the latest events are kept.
+// The rings are dumped as Chrome trace JSON at the end, which can be
+// loaded into 'chrome://tracing' or 'ui.perfetto.dev'.
+
+#define TRACE_EVENTS (1u << 14)
+
+typedef struct Event { const char * name; uint64_t begin, end; } Event;
+
+typedef struct Ring {
+  int pid;
+  uint64_t count;
+  Event events[TRACE_EVENTS];
+} Ring;
+
+static int num_rings;
+static Ring * rings, * ring;
+
+static uint64_t now () {
+  struct timespec ts;
+  clock_gettime (CLOCK_MONOTONIC, &ts);
+  return 1000000000ull * ts.tv_sec + ts.tv_nsec;
+}
+
+static void init_trace (int processes) {
+  num_rings = processes;
+  rings = mmap (0, num_rings * sizeof *rings, PROT_READ | PROT_WRITE,
+    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (rings == MAP_FAILED) die ("can not map %d trace buffers", num_rings);
+  ring = rings;
+  ring->pid = getpid ();
+}
+
+// Start a span, which is a no-op returning zero if tracing is disabled.
+
+static inline uint64_t trace_begin () {
+  return ring ? now () : 0;
+}
+
+static inline void trace_end (const char * name, uint64_t begin) {
+  if (!ring) return;
+  Event * event = ring->events + ring->count++ % TRACE_EVENTS;
+  event->name = name;
+  event->begin = begin;
+  event->end = now ();
+}
+
+// Switch to a fresh ring buffer in a forked child process.
+
+static void trace_child (int child) {
+  if (!ring) return;
+  assert (child + 1 < num_rings);
+  ring = rings + child + 1;
+  ring->pid = getpid ();
+}
+
+static void dump_trace () {
+  if (!rings) return;
+  FILE * file = fopen (trace_path, "w");
+  if (!file) die ("can not write trace '%s'", trace_path);
+  uint64_t start = UINT64_MAX, events = 0;
+  for (int r = 0; r < num_rings; r++) {
+    const Ring * p = rings + r;
+    const uint64_t n = p->count < TRACE_EVENTS ? p->count : TRACE_EVENTS;
+    for (uint64_t i = 0; i < n; i++)
+      if (p->events[i].begin < start) start = p->events[i].begin;
+  }
+  fputs ("{\"traceEvents\":[\n", file);
+  for (int r = 0; r < num_rings; r++) {
+    const Ring * p = rings + r;
+    if (!p->pid) continue;
+    if (r)
+      fprintf (file,
+	"%s{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	"\"args\":{\"name\":\"shard %d\"}}",
+	events ? ",\n" : "", p->pid, r - 1);
+    else
+      fprintf (file,
+	"{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+	"\"args\":{\"name\":\"scranfilize\"}}", p->pid);
+    events++;
+    const uint64_t n = p->count < TRACE_EVENTS ? p->count : TRACE_EVENTS;
+    for (uint64_t i = p->count - n; i < p->count; i++) {
+      const Event * e = p->events + i % TRACE_EVENTS;
+      fprintf (file,
+        ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,"
+	"\"ts\":%.3f,\"dur\":%.3f}",
+	e->name, p->pid, p->pid,
+	(e->begin - start) / 1e3, (e->end - e->begin) / 1e3);
+      events++;
+    }
+  }
+  fputs ("\n],\"displayTimeUnit\":\"ms\"}\n", file);
+  if (fclose (file)) die ("closing trace '%s' failed", trace_path);
+  msg ("wrote %" PRIu64 " trace events to '%s'", events, trace_path);
+  munmap (rings, num_rings * sizeof *rings);
+  rings = ring = 0;
+}
+
+/*------------------------------------------------------------------------*/
+
+// MD5 message digest (RFC 1321) used for GBD instance hashes.
+
+typedef struct MD5 {
+  uint32_t state[4];
+  uint64_t bytes;
+  unsigned char block[64];
+} MD5;
+
+static void md5_init (MD5 * md5) {
+  md5->state[0] = 0x67452301;
+  md5->state[1] = 0xefcdab89;
+  md5->state[2] = 0x98badcfe;
+  md5->state[3] = 0x10325476;
+  md5->bytes = 0;
+}
+
+static void md5_transform (MD5 * md5, const unsigned char * block) {
+  static const uint32_t K[64] = {
+    0xd76aa478, 0xe8c7b756, 0x242070db, 0xc1bdceee, 0xf57c0faf, 0x4787c62a,
+    0xa8304613, 0xfd469501, 0x698098d8, 0x8b44f7af, 0xffff5bb1, 0x895cd7be,
+    0x6b901122, 0xfd987193, 0xa679438e, 0x49b40821, 0xf61e2562, 0xc040b340,
+    0x265e5a51, 0xe9b6c7aa, 0xd62f105d, 0x02441453, 0xd8a1e681, 0xe7d3fbc8,
+    0x21e1cde6, 0xc33707d6, 0xf4d50d87, 0x455a14ed, 0xa9e3e905, 0xfcefa3f8,
+    0x676f02d9, 0x8d2a4c8a, 0xfffa3942, 0x8771f681, 0x6d9d6122, 0xfde5380c,
+    0xa4beea44, 0x4bdecfa9, 0xf6bb4b60, 0xbebfbc70, 0x289b7ec6, 0xeaa127fa,
+    0xd4ef3085, 0x04881d05, 0xd9d4d039, 0xe6db99e5, 0x1fa27cf8, 0xc4ac5665,
+    0xf4292244, 0x432aff97, 0xab9423a7, 0xfc93a039, 0x655b59c3, 0x8f0ccc92,
+    0xffeff47d, 0x85845dd1, 0x6fa87e4f, 0xfe2ce6e0, 0xa3014314, 0x4e0811a1,
+    0xf7537e82, 0xbd3af235, 0x2ad7d2bb, 0xeb86d391
+  };
+  static const unsigned char R[64] = {
+    7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22, 7, 12, 17, 22,
+    5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20, 5,  9, 14, 20,
+    4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23, 4, 11, 16, 23,
+    6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21, 6, 10, 15, 21
+  };
+  uint32_t M[16];
+  for (int i = 0; i < 16; i++)
+    M[i] = (uint32_t) block[4*i] | (uint32_t) block[4*i+1] << 8 |
+           (uint32_t) block[4*i+2] << 16 | (uint32_t) block[4*i+3] << 24;
+  uint32_t a = md5->state[0], b = md5->state[1];
+  uint32_t c = md5->state[2], d = md5->state[3];
+  for (int i = 0; i < 64; i++) {
+    uint32_t f;
+    int g;
+    if (i < 16) f = (b & c) | (~b & d), g = i;
+    else if (i < 32) f = (d & b) | (~d & c), g = (5*i + 1) & 15;
+    else if (i < 48) f = b ^ c ^ d, g = (3*i + 5) & 15;
+    else f = c ^ (b | ~d), g = (7*i) & 15;
+    const uint32_t tmp = d;
+    d = c;
+    c = b;
+    const uint32_t x = a + f + K[i] + M[g];
+    b += (x << R[i]) | (x >> (32 - R[i]));
+    a = tmp;
+  }
+  md5->state[0] += a, md5->state[1] += b;
+  md5->state[2] += c, md5->state[3] += d;
+}
+
+static void md5_update (MD5 * md5, const void * data, size_t size) {
+  const unsigned char * p = data;
+  size_t used = md5->bytes & 63;
+  md5->bytes += size;
+  if (used) {
+    size_t n = 64 - used;
+    if (n > size) n = size;
+    memcpy (md5->block + used, p, n);
+    p += n, size -= n, used += n;
+    if (used < 64) return;
+    md5_transform (md5, md5->block);
+  }
+  for (; size >= 64; p += 64, size -= 64)
+    md5_transform (md5, p);
+  memcpy (md5->block, p, size);
+}
+
+// Finish and write the digest as 32 hexadecimal digits into 'hex'.
+
+static void md5_final (MD5 * md5, char hex[33]) {
+  const uint64_t bits = 8 * md5->bytes;
+  const unsigned char pad = 0x80, zero = 0;
+  md5_update (md5, &pad, 1);
+  while ((md5->bytes & 63) != 56) md5_update (md5, &zero, 1);
+  unsigned char length[8];
+  for (int i = 0; i < 8; i++) length[i] = bits >> (8*i);
+  md5_update (md5, length, 8);
+  for (int i = 0; i < 16; i++)
+    sprintf (hex + 2*i, "%02x", (md5->state[i/4] >> (8 * (i & 3))) & 0xff);
+}
+
+// GBD normalizes a CNF to its tokens (literals and zeros) separated by a
+// single space wherever there was white space between them, skipping
+// comment and header lines.  Thus 'gbd_update' drops white space and
+// emits a single space in front of the next token instead, except for
+// the first token.  If the last token is not a terminating zero, then
+// GBD appends ' 0' before finalizing the hash.
+
+typedef struct GBD { MD5 md5; bool start, space, zero; } GBD;
+
+static void gbd_init (GBD * gbd) {
+  md5_init (&gbd->md5);
+  gbd->start = gbd->zero = true;
+  gbd->space = false;
+}
+
+static void gbd_update (GBD * gbd, const char * text, size_t size) {
+  char buffer[256];
+  size_t n = 0;
+  for (const char * p = text; p != text + size; p++) {
+    if (*p == ' ' || *p == '\n') {
+      gbd->space = !gbd->start;
+      continue;
+    }
+    if (n + 2 > sizeof buffer) md5_update (&gbd->md5, buffer, n), n = 0;
+    gbd->zero = (*p == '0' && (gbd->space || gbd->start));
+    gbd->start = false;
+    if (gbd->space) buffer[n++] = ' ', gbd->space = false;
+    buffer[n++] = *p;
+  }
+  md5_update (&gbd->md5, buffer, n);
+}
+
+static void gbd_final (GBD * gbd, char hex[33]) {
+  if (!gbd->zero) md5_update (&gbd->md5, " 0", 2);
+  md5_final (&gbd->md5, hex);
+}
+
+/*------------------------------------------------------------------------*/
+
 bool exists_file (const char * path) {
   struct stat buf;
   return !stat (path, &buf);
@@ -117,17 +589,116 @@ static bool is_suffix (const char * path, const char * suffix) {
   return k > l && !strcmp (path + k - l, suffix);
 }
 
+static bool read_line (const char * path, char * line, size_t size) {
+  FILE * file = fopen (path, "r");
+  if (!file) return false;
+  const bool res = fgets (line, size, file);
+  fclose (file);
+  return res;
+}
+
+// CPUs available to this process, respecting cgroup (v2 and v1) quotas.
+
+static int cgroup_cpus () {
+  long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+  if (cpus < 1) cpus = 1;
+  char line[128];
+  long quota = -1, period = 0;
+  if (read_line ("/sys/fs/cgroup/cpu.max", line, sizeof line)) {
+    if (sscanf (line, "%ld %ld", &quota, &period) != 2) quota = -1;
+  } else if (read_line ("/sys/fs/cgroup/cpu/cpu.cfs_quota_us",
+                        line, sizeof line)) {
+    quota = atol (line);
+    if (read_line ("/sys/fs/cgroup/cpu/cpu.cfs_period_us",
+                   line, sizeof line))
+      period = atol (line);
+  }
+  if (quota > 0 && period > 0) {
+    long limit = (quota + period - 1) / period;
+    if (limit < cpus) cpus = limit;
+  }
+  return cpus > INT_MAX ? INT_MAX : cpus;
+}
+
+// Memory available to this process in bytes (zero if unlimited).
+
+static uint64_t cgroup_memory () {
+  char line[128];
+  if (!read_line ("/sys/fs/cgroup/memory.max", line, sizeof line) &&
+      !read_line ("/sys/fs/cgroup/memory/memory.limit_in_bytes",
+                  line, sizeof line))
+    return 0;
+  if (!isdigit ((unsigned char) line[0])) return 0;
+  return strtoull (line, 0, 10);
+}
+
+// Number of processes (or threads) to use for parallel stages.
+
+static int processes () {
+  return max_processes ? max_processes : cgroup_cpus ();
+}
+
+// The format of a decompression command has the path as first and the
+// number of threads as second argument, which is ignored by sequential
+// decoders.
+
 static FILE *
 open_pipe (const char * path, const char * fmt, int * close_file) {
-  char * cmd = malloc (strlen (fmt) + strlen (path));
+  char * cmd = malloc (strlen (fmt) + strlen (path) + 16);
   if (!cmd) die ("out-of-memory allocating command string");
-  sprintf (cmd, fmt, path);
+  sprintf (cmd, fmt, path, processes ());
+  msg ("decompressing with '%s'", cmd);
   FILE * file = popen (cmd, "r");
   *close_file = 2;
   free (cmd);
   return file;
 }
 
+static bool has_program (const char * name) {
+  const char * path = getenv ("PATH");
+  if (!path) return false;
+  char buffer[4096];
+  while (*path) {
+    const char * end = strchr (path, ':');
+    if (!end) end = path + strlen (path);
+    const size_t len = end - path;
+    if (len && len + strlen (name) + 2 <= sizeof buffer) {
+      memcpy (buffer, path, len);
+      buffer[len] = '/';
+      strcpy (buffer + len + 1, name);
+      if (!access (buffer, X_OK)) return true;
+    }
+    path = *end ? end + 1 : end;
+  }
+  return false;
+}
+
+// Faster decoders for 'gzip' and 'bzip2' files are preferred over the
+// sequential ones if they are installed.  Only 'rapidgzip', 'pugz' and
+// 'lbzip2' decode single-stream files block-parallel.  The fallback
+// 'pigz' inflates on one thread with helper threads for reading, writing
+// and checksums, and 'pbzip2' only decodes multi-stream files in parallel.
+// Each list is terminated by the sequential decoder, always tried last.
+
+static const char * gzip_decoders[] = {
+  "rapidgzip", "rapidgzip -d -c %s -P %d",
+  "pugz", "pugz -t %2$d %1$s",
+  "pigz", "pigz -c -d %s -p %d",
+  0, "gzip -c -d %s"
+};
+
+static const char * bzip2_decoders[] = {
+  "lbzip2", "lbzip2 -c -d %s -n %d",
+  "pbzip2", "pbzip2 -c -d %s -p%d",
+  0, "bzip2 -c -d %s"
+};
+
+static const char * decoder (const char ** decoders) {
+  while (decoders[0] && (processes () == 1 || !has_program (decoders[0])))
+    decoders += 2;
+  return decoders[1];
+}
+
 static int next_char (FILE * file, int * lineno) {
   int res = getc (file);
   if (res == '\n') *lineno += 1;
@@ -152,6 +723,542 @@ parse_error (const char * path, int lineno, const char * msg, ...) {
   exit (1);
 }
 
+static const char * format () {
+  return weighted ? "wcnf" : "cnf";
+}
+
+#define TOKENIZE_BATCH (1 << 16)
+
+static uint64_t batch_begin;
+
+// GBD instance hash ('--gbd-hash').  The hash is the MD5 digest of the
+// normalized token stream of the clauses (see 'gbd_update'), which for
+// the scrambled CNF is computed from the formatted output of the writer.
+
+static GBD input_gbd;
+static char input_hash[33], scrambled_hash[33];
+
+static void hash_clause (const int * literals, int size) {
+  char text[16];
+  for (int i = 0; i < size; i++) {
+    const int len = sprintf (text, "%d ", literals[i]);
+    gbd_update (&input_gbd, text, len);
+  }
+  gbd_update (&input_gbd, "0\n", 2);
+}
+
+static inline int tag (Ref ref) { return ref & 3; }
+
+static inline const int * clause_literals (Ref ref) {
+  const size_t offset = ref >> 2;
+  switch (tag (ref)) {
+    case BINARY_CLAUSE: return binaries + 2 * offset;
+    case TERNARY_CLAUSE: return ternaries + 3 * offset;
+    default: return arena + offset;
+  }
+}
+
+static int clause_size (int j) {
+  const Ref ref = clauses[j];
+  switch (tag (ref)) {
+    case BINARY_CLAUSE: return 2;
+    case TERNARY_CLAUSE: return 3;
+    default: {
+      const int * begin = arena + (ref >> 2), * p = begin;
+      while (*p) p++;
+      return p - begin;
+    }
+  }
+}
+
+// Push 'size' literals onto one of the clause arrays and return the
+// offset of the first pushed literal.
+
+static size_t
+push_literals (int ** array, size_t * num, size_t * size,
+               const int * literals, size_t n) {
+  if (*num + n > *size) {
+    size_t new_size = *size ? 2 * *size : 1024;
+    while (*num + n > new_size) new_size *= 2;
+    *array = huge_realloc (*array, *size * sizeof **array,
+                           new_size * sizeof **array);
+    if (!*array) die ("out-of-memory reallocating clause store");
+    *size = new_size;
+  }
+  const size_t res = *num;
+  memcpy (*array + res, literals, n * sizeof **array);
+  *num += n;
+  return res;
+}
+
+// Page cache friendly input ('--cache-window <MB>').  Plain files are
+// read sequentially and whenever a window worth of input has been read
+// the pages behind the read position are dropped from the page cache.
+// Pages still under read-ahead can not be dropped, thus each range starts
+// at the previous one, and at the end the whole file is dropped.
+
+static FILE * input_file;
+static off_t input_dropped, input_position;
+
+static void advise_input (FILE * file) {
+  struct stat buf;
+  if (fstat (fileno (file), &buf) || !S_ISREG (buf.st_mode)) return;
+  input_file = file;
+  input_dropped = input_position = 0;
+  posix_fadvise (fileno (file), 0, 0, POSIX_FADV_SEQUENTIAL);
+}
+
+static void drop_input (bool all) {
+  const int fd = fileno (input_file);
+  if (all) {
+    posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+    return;
+  }
+  const off_t offset = ftello (input_file);
+  if (offset < input_position + (off_t) cache_window) return;
+  posix_fadvise (fd, input_dropped, offset - input_dropped,
+    POSIX_FADV_DONTNEED);
+  input_dropped = input_position;
+  input_position = offset;
+}
+
+// Range-restricted output ('--range <a>:<b>').  Only the clauses at the
+// output positions from 'a' to 'b' (exclusive) are printed, and only the
+// header if 'a' is zero.  Since the maps only depend on the seed and the
+// header counts, concatenating the output of all ranges with the same
+// (explicit) seed gives the same CNF as scrambling in one go.  The clause map is computed right after
+// reading the header and only the 'needed' clauses are stored.
+
+static bool * needed;
+static int range_clauses;
+
+static int * rank (int n, bool permute, double width);
+
+static void select_range (int specified_clauses) {
+  if (new_wcnf) die ("'--range' needs clause count in header");
+  if (range_end > specified_clauses) range_end = specified_clauses;
+  if (range_begin > range_end) range_begin = range_end;
+  msg ("restricting output to clauses %d to %d",
+    range_begin, range_end);
+  range_clauses = specified_clauses;
+  const uint64_t begin = trace_begin ();
+  clause_map =
+    rank (range_clauses, permute_clauses, clause_move_window);
+  trace_end ("rank clauses", begin);
+  needed = calloc (range_clauses, sizeof *needed);
+  if (!needed) die ("out-of-memory allocating needed clauses");
+  for (int i = range_begin; i < range_end; i++) {
+    int j = clause_map[i];
+    if (reverse_clauses) j = range_clauses-1 - j;
+    needed[j] = true;
+  }
+}
+
+static void
+new_clause (const int * literals, int size, uint64_t weight, bool xor) {
+  if (ring && !(num_clauses % TOKENIZE_BATCH)) {
+    if (num_clauses) trace_end ("tokenize batch", batch_begin);
+    batch_begin = trace_begin ();
+  }
+  if (gbd_hash) hash_clause (literals, size);
+  if (input_file && !(num_clauses % TOKENIZE_BATCH)) drop_input (false);
+  if (xor) num_xors++;
+  if (num_clauses == size_clauses) {
+    const size_t old_size = size_clauses;
+    size_clauses = size_clauses ? 2 * size_clauses : 1;
+    clauses = huge_realloc (clauses, old_size * sizeof *clauses,
+                            size_clauses * sizeof *clauses);
+    if (!clauses) die ("out-of-memory reallocating clauses");
+    if (weighted) {
+      weights = huge_realloc (weights, old_size * sizeof *weights,
+                              size_clauses * sizeof *weights);
+      if (!weights) die ("out-of-memory reallocating weights");
+    }
+  }
+  Ref ref;
+  if (needed && num_clauses < range_clauses && !needed[num_clauses])
+    ref = 0;                            // Not printed (see 'range').
+  else if (!xor && size == 2) {
+    const size_t offset = push_literals (&binaries,
+      &num_binaries, &size_binaries, literals, 2);
+    ref = (Ref) (offset / 2) << 2 | BINARY_CLAUSE;
+  } else if (!xor && size == 3) {
+    const size_t offset = push_literals (&ternaries,
+      &num_ternaries, &size_ternaries, literals, 3);
+    ref = (Ref) (offset / 3) << 2 | TERNARY_CLAUSE;
+  } else {
+    const int zero = 0;
+    const size_t offset = push_literals (&arena,
+      &num_arena, &size_arena, literals, size);
+    push_literals (&arena, &num_arena, &size_arena, &zero, 1);
+    ref = (Ref) offset << 2 | (xor ? XOR_CLAUSE : LONG_CLAUSE);
+  }
+  if (weighted) weights[num_clauses] = weight;
+  clauses[num_clauses++] = ref;
+}
+
+/*------------------------------------------------------------------------*/
+
+// Trusted input parser ('--trust-input').  Instead of checking every
+// character inline the tokenizer only classifies characters through a
+// table and records the first offending character and the maximum
+// variable index seen.  These are checked after the whole file has been
+// read, which keeps the hot loop almost free of unpredictable branches.
+
+enum {
+  OTHER = 0, SPACE = 1, DIGIT = 2, MINUS = 3, COMMENT = 4, HARD = 5, XOR = 6
+};
+
+static unsigned char char_class[256];
+
+static void init_char_class () {
+  char_class[' '] = char_class['\t'] = SPACE;
+  char_class['\r'] = char_class['\n'] = SPACE;
+  for (int ch = '0'; ch <= '9'; ch++) char_class[ch] = DIGIT;
+  char_class['-'] = MINUS;
+  char_class['c'] = COMMENT;
+  if (new_wcnf) char_class['h'] = HARD;
+  if (!weighted) char_class['x'] = XOR;
+}
+
+static void
+parse_trusted (const char * path, FILE * file,
+               int lineno, int specified_clauses) {
+
+  init_char_class ();
+
+  int num_literals = 0, size_literals = 0, * literals = 0;
+  const uint64_t limit = (uint64_t) INT_MAX + 1;
+  uint64_t max_idx = 0;
+  int invalid_char = 0, invalid_lineno = 0;
+  bool invalid_literal = false;         // Invalid character after literal.
+
+  bool expect_weight = weighted;
+  uint64_t weight = 0;
+  bool xor = false;
+
+  int ch = getc_unlocked (file);
+  while (ch != EOF) {
+    lineno += (ch == '\n');
+    switch (char_class[ch]) {
+      case SPACE:
+	ch = getc_unlocked (file);
+	break;
+      case COMMENT:
+	while ((ch = getc_unlocked (file)) != '\n' && ch != EOF)
+	  ;
+	break;
+      case HARD:
+	if (!expect_weight && !invalid_lineno)
+	  invalid_char = ch, invalid_lineno = lineno;
+	weight = 0, expect_weight = false;
+	ch = getc_unlocked (file);
+	break;
+      case XOR:
+	if ((xor || num_literals) && !invalid_lineno)
+	  invalid_char = ch, invalid_lineno = lineno;
+	xor = true;
+	ch = getc_unlocked (file);
+	break;
+      case OTHER:
+	if (!invalid_lineno) invalid_char = ch, invalid_lineno = lineno;
+	ch = getc_unlocked (file);
+	break;
+      default: {
+	const int sign = (ch == '-');
+	if (sign) {
+	  ch = getc_unlocked (file);
+	  if ((unsigned) (ch - '1') > 8 && !invalid_lineno)
+	    invalid_char = '-', invalid_lineno = lineno;
+	}
+	if (expect_weight) {
+	  if (sign)
+	    parse_error (path, lineno,
+	      "expected digit%s", new_wcnf ? " or 'h'" : "");
+	  weight = 0;
+	  while ((unsigned) (ch - '0') < 10) {
+	    if (UINT64_MAX/10 < weight)
+	      parse_error (path, lineno, "weight way too large");
+	    weight *= 10;
+	    const int digit = ch - '0';
+	    if (UINT64_MAX - digit < weight)
+	      parse_error (path, lineno, "weight too large");
+	    weight += digit;
+	    ch = getc_unlocked (file);
+	  }
+	  if (!weight) parse_error (path, lineno, "invalid zero weight");
+	  expect_weight = false;
+	  break;
+	}
+	uint64_t idx = 0;
+	while ((unsigned) (ch - '0') < 10) {
+	  idx = 10 * idx + (ch - '0');
+	  idx = idx > limit ? limit : idx;
+	  ch = getc_unlocked (file);
+	}
+	if (sign && !idx) break;        // Lone '-' or '-0' (recorded above).
+	if (ch != EOF && char_class[ch] != SPACE &&
+	    char_class[ch] != COMMENT && !invalid_lineno)
+	  invalid_char = ch, invalid_lineno = lineno, invalid_literal = true;
+	if (idx > INT_MAX) parse_error (path, lineno, "variable too large");
+	if (idx > max_idx) max_idx = idx;
+	if (idx) {
+	  if (num_literals == size_literals) {
+	    if (size_literals) size_literals *= 2; else size_literals = 1;
+	    literals = realloc (literals, size_literals * sizeof *literals);
+	    if (!literals)
+	      die ("out-of-memory reallocating literal stack");
+	  }
+	  const int lit = (int) idx;
+	  literals[num_literals++] = sign ? -lit : lit;
+	} else {
+	  if (num_clauses == specified_clauses)
+	    parse_error (path, lineno, "too many clauses");
+	  new_clause (literals, num_literals, weight, xor);
+	  num_literals = 0;
+	  xor = false;
+	  expect_weight = weighted;
+	}
+      }
+    }
+  }
+
+  if (literals) free (literals);
+
+  if (new_wcnf) max_var = max_idx;
+
+  if (!validate) return;
+
+  if (invalid_lineno) {
+    if (invalid_literal && isprint (invalid_char))
+      parse_error (path, invalid_lineno,
+        "unexpected character '%c' after literal", invalid_char);
+    else if (invalid_literal)
+      parse_error (path, invalid_lineno,
+        "unexpected character after literal (code '%d')", invalid_char);
+    else if (invalid_char == '-')
+      parse_error (path, invalid_lineno, "expected non-zero digit after '-'");
+    else if (isprint (invalid_char))
+      parse_error (path, invalid_lineno,
+        "unexpected character '%c'", invalid_char);
+    else
+      parse_error (path, invalid_lineno,
+        "unexpected character (code '%d')", invalid_char);
+  }
+  if (num_literals || xor || expect_weight != weighted)
+    parse_error (path, lineno, "terminating zero missing");
+  if (!new_wcnf && num_clauses < specified_clauses)
+    parse_error (path, lineno, "%d clause%s missing",
+      specified_clauses - num_clauses,
+      num_clauses + 1 == specified_clauses ? "" : "s");
+  if (max_idx > (uint64_t) max_var) {
+    for (int i = 0; i < num_clauses; i++) {
+      if (needed && i < range_clauses && !needed[i]) continue;
+      const int * p = clause_literals (clauses[i]);
+      const int * end = p + clause_size (i);
+      for (; p != end; p++)
+	if (abs (*p) > max_var)
+	  die ("maximum variable index exceeded by literal '%d' "
+	       "in clause %d of '%s'", *p, i + 1, path);
+    }
+    if (needed) die ("maximum variable index exceeded in '%s'", path);
+    assert (!"reachable");
+  }
+}
+
+/*------------------------------------------------------------------------*/
+
+static void new_block (int type) {
+  if (num_blocks == size_blocks) {
+    size_blocks = size_blocks ? 2 * size_blocks : 1;
+    blocks = realloc (blocks, size_blocks * sizeof *blocks);
+    if (!blocks) die ("out-of-memory reallocating quantifier blocks");
+  }
+  Block * block = blocks + num_blocks++;
+  block->type = type;
+  block->start = num_prefix;
+  block->size = 0;
+}
+
+static void push_prefix (int idx) {
+  if (num_prefix == size_prefix) {
+    size_prefix = size_prefix ? 2 * size_prefix : 1;
+    prefix = realloc (prefix, size_prefix * sizeof *prefix);
+    if (!prefix) die ("out-of-memory reallocating prefix");
+  }
+  prefix[num_prefix++] = idx;
+  blocks[num_blocks-1].size++;
+}
+
+// Move free variables into a new outermost block such that 'prefix'
+// covers all variables and each variable belongs to exactly one block.
+
+static void finish_prefix (bool * quantified) {
+  const int num_quantified = num_prefix;
+  new_block (FREE);
+  for (int idx = 1; idx <= max_var; idx++)
+    if (!quantified[idx-1]) push_prefix (idx);
+  Block free_block = blocks[num_blocks-1];
+  const int num_free = free_block.size;
+  int * tmp = malloc (max_var * sizeof *tmp);
+  if (!tmp) die ("out-of-memory allocating prefix");
+  memcpy (tmp, prefix + num_quantified, num_free * sizeof *tmp);
+  memcpy (tmp + num_free, prefix, num_quantified * sizeof *tmp);
+  free (prefix);
+  prefix = tmp;
+  size_prefix = max_var;
+  for (int b = num_blocks-1; b > 0; b--) {
+    blocks[b] = blocks[b-1];
+    blocks[b].start += num_free;
+  }
+  free_block.start = 0;
+  blocks[0] = free_block;
+  msg ("found %d quantifier blocks with %d quantified variables",
+    num_blocks - 1, num_quantified);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Seekable compressed input.  If the original CNF was written in frames
+// by scranfilize (see 'print_frames') and '<original-cnf>.index' matches
+// its size, then a feeder process decodes up to 'processes ()' frames in
+// parallel, each by a job process which streams its decoded frame in
+// fixed chunks through its own pipe.  Thus jobs only decode ahead as far
+// as their pipe capacity allows.  The feeder passes on the decoded frames
+// in order through a single pipe.
+
+#define FRAME_CHUNK (1 << 16)
+
+typedef struct Frame { uint64_t offset, bytes; } Frame;
+
+static const char * frame_decoder (const char * path) {
+  if (is_suffix (path, ".zst")) return "zstd -q -c -d";
+  if (is_suffix (path, ".xz")) return "xz -c -d";
+  if (is_suffix (path, ".gz")) return "gzip -c -d";
+  return 0;
+}
+
+static Frame * read_index (const char * path, int * frames) {
+  char * index = malloc (strlen (path) + 8);
+  if (!index) die ("out-of-memory allocating index path");
+  sprintf (index, "%s.index", path);
+  FILE * file = fopen (index, "r");
+  free (index);
+  if (!file) return 0;
+  struct stat buf;
+  uint64_t size;
+  Frame * res = 0;
+  int n = 0, ch;
+  while ((ch = getc (file)) == 'c')
+    while ((ch = getc (file)) != '\n' && ch != EOF)
+      ;
+  ungetc (ch, file);
+  if (fscanf (file, "size %" SCNu64 " frames %d", &size, &n) == 2 &&
+      !stat (path, &buf) && (uint64_t) buf.st_size == size && n > 0 &&
+      (res = malloc (n * sizeof *res))) {
+    for (int i = 0; i < n; i++) {
+      int frame, first, clauses;
+      if (fscanf (file, "%d %d %d %" SCNu64 " %" SCNu64,
+                  &frame, &first, &clauses,
+		  &res[i].offset, &res[i].bytes) != 5 || frame != i) {
+	free (res);
+	res = 0;
+	break;
+      }
+    }
+  }
+  fclose (file);
+  if (!res) msg ("ignoring stale or invalid index of '%s'", path);
+  *frames = n;
+  return res;
+}
+
+static void
+decode_frame (const char * path, const Frame * frame, int fd, int out) {
+  close (out);
+  char * cmd = malloc (strlen (path) + 128);
+  if (!cmd) _exit (1);
+  sprintf (cmd, "tail -c +%" PRIu64 " '%s' | head -c %" PRIu64 " | %s",
+    frame->offset + 1, path, frame->bytes, frame_decoder (path));
+  FILE * file = popen (cmd, "r");
+  char * buffer = malloc (FRAME_CHUNK);
+  if (!file || !buffer) _exit (1);
+  size_t bytes;
+  while ((bytes = fread (buffer, 1, FRAME_CHUNK, file)))
+    for (size_t written = 0; written < bytes; ) {
+      const ssize_t n = write (fd, buffer + written, bytes - written);
+      if (n <= 0) _exit (1);
+      written += n;
+    }
+  if (pclose (file)) _exit (1);
+  _exit (0);
+}
+
+static pid_t
+start_frame (const char * path, const Frame * frame, int out, int * fd) {
+  int fds[2];
+  if (pipe (fds)) _exit (1);
+#ifdef F_SETPIPE_SZ
+  fcntl (fds[1], F_SETPIPE_SZ, 16 * FRAME_CHUNK);  // Decode ahead 1 MB.
+#endif
+  const pid_t pid = fork ();
+  if (pid < 0) _exit (1);
+  if (!pid) close (fds[0]), decode_frame (path, frame, fds[1], out);
+  close (fds[1]);
+  *fd = fds[0];
+  return pid;
+}
+
+static void feed_frames (const char * path, Frame * frames, int n, int out) {
+  const int window = processes ();
+  pid_t * jobs = malloc (n * sizeof *jobs);
+  int * fds = malloc (n * sizeof *fds);
+  char * buffer = malloc (FRAME_CHUNK);
+  if (!jobs || !fds || !buffer) _exit (1);
+  for (int i = 0; i < n && i < window; i++)
+    jobs[i] = start_frame (path, frames + i, out, fds + i);
+  for (int i = 0; i < n; i++) {
+    ssize_t bytes;
+    while ((bytes = read (fds[i], buffer, FRAME_CHUNK)) > 0)
+      for (ssize_t written = 0; written < bytes; ) {
+	const ssize_t tmp = write (out, buffer + written, bytes - written);
+	if (tmp <= 0) _exit (1);
+	written += tmp;
+      }
+    close (fds[i]);
+    int status;
+    if (waitpid (jobs[i], &status, 0) != jobs[i] ||
+        !WIFEXITED (status) || WEXITSTATUS (status))
+      _exit (1);
+    if (i + window < n)
+      jobs[i + window] = start_frame (path, frames + i + window,
+                                      out, fds + i + window);
+  }
+  _exit (0);
+}
+
+static FILE * open_frames (const char * path, pid_t * feeder) {
+  if (!frame_decoder (path)) return 0;
+  int n;
+  Frame * frames = read_index (path, &n);
+  if (!frames) return 0;
+  msg ("decoding %d indexed frames of '%s' with %d process%s",
+    n, path, processes (), processes () == 1 ? "" : "es");
+  int fds[2];
+  if (pipe (fds)) die ("can not create pipe for frames");
+  fflush (stdout);
+  fflush (stderr);
+  const pid_t pid = fork ();
+  if (pid < 0) die ("can not fork frame feeder");
+  if (!pid) close (fds[0]), feed_frames (path, frames, n, fds[1]);
+  close (fds[1]);
+  free (frames);
+  *feeder = pid;
+  return fdopen (fds[0], "r");
+}
+
+/*------------------------------------------------------------------------*/
+
 static void parse (const char * path) {
 
 #define suffix(STR) is_suffix (path, STR)
@@ -163,30 +1270,39 @@ static void parse (const char * path) {
 
   FILE * file;
   int close_file;
+  pid_t feeder = 0;
 
   if (!path) {
     path = "<stdin>";
     file = stdin;
     close_file = 0;
-  } else if (suffix (".xz") || suffix (".lzma")) pipe ("xz -c -d %s");
-  else if (suffix (".bz2")) pipe ("bzip2 -c -d %s");
-  else if (suffix (".gz")) pipe ("gzip -c -d %s");
+  } else if ((file = open_frames (path, &feeder))) close_file = 3;
+  else if (suffix (".zst")) pipe ("zstd -q -c -d %s");
+  else if (suffix (".xz") || suffix (".lzma")) pipe ("xz -c -d -T %2$d %1$s");
+  else if (suffix (".bz2")) pipe (decoder (bzip2_decoders));
+  else if (suffix (".gz")) pipe (decoder (gzip_decoders));
   else if (suffix (".7z")) pipe ("7z x -so %s 2>/dev/null");
   else {
     file = fopen (path, "r");
     close_file = 1;
   }
   if (!file) die ("can not read original CNF '%s'", path);
+  if (read_buffer_size && setvbuf (file, 0, _IOFBF, read_buffer_size))
+    die ("can not set read buffer size of '%s'", path);
+  if (cache_window && close_file == 1) advise_input (file);
   msg ("reading original CNF from '%s'", path);
 
+  const uint64_t begin = trace_begin ();
+
   int lineno = 1;
 
-  int ch;
+  int ch, headerless_char = 0, headerless_lineno = 0;
 
   for (;;) {
     ch = next ();
     if (ch == EOF) perr ("unexpected end-of-file before header");
     if (ch == 'p') break;
+    if (ch == 'h' || isdigit (ch)) break;
     if (ch == 'c') {
       while ((ch = next ()) != '\n')
 	if (ch == EOF)
@@ -198,16 +1314,27 @@ static void parse (const char * path) {
     else perr ("unexpected character (code '%d')", ch);
   }
 
-  assert (ch == 'p');
-  if (next () != ' ' ||
-      next () != 'c' ||
+  int specified_clauses;
+
+  if (ch != 'p') {
+    headerless_char = ch, headerless_lineno = lineno;
+    msg ("found new-style WCNF without header");
+    weighted = new_wcnf = true;
+    specified_clauses = INT_MAX;
+    goto BODY;
+  }
+
+  if (next () != ' ') perr ("invalid DIMACS header");
+  ch = next ();
+  if (ch == 'w') weighted = true, ch = next ();
+  if (ch != 'c' ||
       next () != 'n' ||
       next () != 'f' ||
       next () != ' ')
     perr ("invalid DIMACS header");
 
   ch = next ();
-  if (!isdigit (ch)) perr ("expected digit after 'p cnf '");
+  if (!isdigit (ch)) perr ("expected digit after 'p %s '", format ());
   max_var = ch - '0';
   while (isdigit (ch = next ())) {
     if (INT_MAX/10 < max_var) perr ("variable number way too large");
@@ -220,9 +1347,10 @@ static void parse (const char * path) {
   if (ch != ' ') perr ("expected space after variable number");
 
   ch = next ();
-  if (!isdigit (ch)) perr ("expected digit after 'p cnf %d'", max_var);
+  if (!isdigit (ch))
+    perr ("expected digit after 'p %s %d'", format (), max_var);
 
-  int specified_clauses = ch - '0';
+  specified_clauses = ch - '0';
   while (isdigit (ch = next ())) {
     if (INT_MAX/10 < specified_clauses)
       perr ("clause number way too large");
@@ -233,31 +1361,136 @@ static void parse (const char * path) {
     specified_clauses += digit;
   }
 
-  msg ("found 'p cnf %d %d' header", max_var, specified_clauses);
+  if (weighted) {
+    while (ch == ' ' || ch == '\t') ch = next ();
+    if (isdigit (ch)) {
+      top_weight = ch - '0';
+      while (isdigit (ch = next ())) {
+	if (UINT64_MAX/10 < top_weight) perr ("top weight way too large");
+	top_weight *= 10;
+	const int digit = ch - '0';
+	if (UINT64_MAX - digit < top_weight) perr ("top weight too large");
+	top_weight += digit;
+      }
+      msg ("found 'p wcnf %d %d %" PRIu64 "' header",
+        max_var, specified_clauses, top_weight);
+    } else
+      msg ("found 'p wcnf %d %d' header", max_var, specified_clauses);
+  } else
+    msg ("found 'p cnf %d %d' header", max_var, specified_clauses);
 
   while (ch != '\n') {
     if (!space (ch)) perr ("expected white space before new line");
     ch = next ();
   }
 
-  clauses = malloc (specified_clauses * sizeof *clauses);
+  clauses = huge_alloc (specified_clauses * sizeof *clauses);
   if (!clauses) die ("out-of-memory allocating clauses");
+  if (weighted) {
+    weights = huge_alloc (specified_clauses * sizeof *weights);
+    if (!weights) die ("out-of-memory allocating weights");
+  }
+  size_clauses = specified_clauses;
 
-  int num_literals = 0, size_literals = 0, * literals = 0;
+  trace_end ("read header", begin);
+
+  if (range_begin >= 0) select_range (specified_clauses);
 
   ch = next ();
-  for (;;) {
+
+  bool * quantified = 0;
+
+  while (!weighted) {
     if (space (ch)) ch = next ();
-    else if (ch == EOF) {
-      if (num_literals) perr ("terminating zero missing");
-      if (num_clauses < specified_clauses)
-	perr ("%d clause%s missing",
-	  num_clauses,
-	  num_clauses + 1 == specified_clauses ? "" : "s");
-      break;
+    else if (ch == 'c') {
+      while ((ch = next ()) != '\n' && ch != EOF)
+	;
+    } else if (ch == 'a' || ch == 'e') {
+      if (!quantified) {
+	quantified = calloc (max_var, sizeof *quantified);
+	if (!quantified) die ("out-of-memory allocating prefix flags");
+      }
+      const int type = ch;
+      new_block (type);
+      ch = next ();
+      for (;;) {
+	if (!space (ch)) perr ("expected space after '%c'", type);
+	while (space (ch)) ch = next ();
+	if (!isdigit (ch)) perr ("expected digit in '%c' line", type);
+	int idx = ch - '0';
+	while (isdigit (ch = next ())) {
+	  if (INT_MAX/10 < idx)
+	    perr ("variable way too large");
+	  idx *= 10;
+	  const int digit = ch - '0';
+	  if (INT_MAX - digit < idx)
+	    perr ("variable too large");
+	  idx += digit;
+	}
+	if (!idx) break;
+	if (idx > max_var) perr ("maximum variable index exceeded");
+	if (quantified[idx-1]) perr ("variable %d quantified twice", idx);
+	quantified[idx-1] = true;
+	push_prefix (idx);
+      }
+    } else break;
+  }
+
+  if (quantified) {
+    finish_prefix (quantified);
+    free (quantified);
+  }
+
+BODY:
+
+  if (trust_input) {
+    ungetc (ch, file);
+    parse_trusted (path, file, lineno, specified_clauses);
+    goto CLOSE;
+  }
+
+  int num_literals = 0, size_literals = 0, * literals = 0;
+
+  bool expect_weight = weighted;
+  uint64_t weight = 0;
+  bool xor = false;
+
+  for (;;) {
+    if (space (ch)) ch = next ();
+    else if (ch == EOF) {
+      if (num_literals || xor || expect_weight != weighted)
+	perr ("terminating zero missing");
+      if (!new_wcnf && num_clauses < specified_clauses)
+	perr ("%d clause%s missing",
+	  specified_clauses - num_clauses,
+	  num_clauses + 1 == specified_clauses ? "" : "s");
+      break;
     } else if (ch == 'c') {
       while ((ch = next ()) != '\n' && ch != EOF)
 	;
+    } else if (expect_weight) {
+      if (new_wcnf && ch == 'h') {
+	weight = 0;
+	ch = next ();
+      } else {
+	if (!isdigit (ch))
+	  perr ("expected digit%s", new_wcnf ? " or 'h'" : "");
+	weight = ch - '0';
+	while (isdigit (ch = next ())) {
+	  if (UINT64_MAX/10 < weight) perr ("weight way too large");
+	  weight *= 10;
+	  const int digit = ch - '0';
+	  if (UINT64_MAX - digit < weight) perr ("weight too large");
+	  weight += digit;
+	}
+	if (!weight) perr ("invalid zero weight");
+      }
+      if (!space (ch)) perr ("expected white space after weight");
+      expect_weight = false;
+    } else if (ch == 'x' && !weighted) {
+      if (xor || num_literals) perr ("unexpected 'x' within clause");
+      xor = true;
+      ch = next ();
     } else {
       int sign;
       if (ch == '-') {
@@ -280,7 +1513,10 @@ static void parse (const char * path) {
 	  perr ("variable too large");
 	idx += digit;
       }
-      if (idx > max_var) perr ("maximum variable index exceeded");
+      if (idx > max_var) {
+	if (new_wcnf) max_var = idx;
+	else perr ("maximum variable index exceeded");
+      }
       if (!space (ch) && ch != 'c' && ch != EOF) {
 	if (isprint (ch))
 	  perr ("unexpected character '%c' after literal", ch);
@@ -298,28 +1534,62 @@ static void parse (const char * path) {
 	}
 	literals[num_literals++] = lit;
       } else {
-	int * clause = malloc ((num_literals + 1) * sizeof *clause);
-	if (!clause) die ("out-of-memory allocating clause");
-	for (int i = 0; i < num_literals; i++) clause[i] = literals[i];
-	clause[num_literals] = 0;
-	num_literals = 0;
 	assert (num_clauses < specified_clauses);
-	clauses[num_clauses++] = clause;
+	new_clause (literals, num_literals, weight, xor);
+	num_literals = 0;
+	xor = false;
+	expect_weight = weighted;
       }
     }
   }
 
+  if (literals) free (literals);
+CLOSE:
+  if (num_clauses) trace_end ("tokenize batch", batch_begin);
+  if (input_file) drop_input (true), input_file = 0;
   if (close_file == 1) fclose (file);
   if (close_file == 2) pclose (file);
-  if (literals) free (literals);
+  if (close_file == 3) {
+    fclose (file);
+    int status;
+    if (waitpid (feeder, &status, 0) != feeder ||
+        !WIFEXITED (status) || WEXITSTATUS (status))
+      die ("decoding frames of '%s' failed", path);
+  }
+  trace_end ("read", begin);
+
+  // Without header only an actual hard clause marks the input as
+  // new-style WCNF.  Otherwise report the same error as for plain CNF.
+
+  if (headerless_lineno) {
+    int i = 0;
+    while (i < num_clauses && weights[i]) i++;
+    if (i == num_clauses)
+      parse_error (path, headerless_lineno,
+        "unexpected character '%c'", headerless_char);
+  }
+
+  if (new_wcnf)
+    msg ("parsed %d clauses with maximum variable %d",
+      num_clauses, max_var);
+  if (num_xors)
+    msg ("parsed %d XOR constraints", num_xors);
+  if (gbd_hash) {
+    if (weighted || num_blocks || num_xors)
+      die ("'--gbd-hash' only supports plain CNF");
+    gbd_final (&input_gbd, input_hash);
+    msg ("original GBD hash '%s'", input_hash);
+  }
 }
 
 /*------------------------------------------------------------------------*/
 
-typedef struct Map { int src; double dst; } Map;
+typedef struct Map { int src, group; double dst; } Map;
 
 static int cmp_rank (const void * p, const void * q) {
   Map * r = (Map *) p, * s = (Map *) q;
+  if (r->group < s->group) return -1;
+  if (r->group > s->group) return 1;
   if (r->dst < s->dst) return -1;
   if (r->dst > s->dst) return 1;
   if (r->src < s->src) return -1;
@@ -331,14 +1601,13 @@ static int * rank (int n, bool permute, double width) {
 
   srand48 (seed);
 
-  typedef struct Map { int src; double dst; } Map;
-
-  Map * ranks = malloc (n * sizeof *ranks);
+  Map * ranks = huge_alloc (n * sizeof *ranks);
   if (!ranks) die ("out-of-memory allocating %d ranks", n);
 
   for (int i = 0; i < n; i++) {
     Map * m = ranks + i;
     m->src = i;
+    m->group = 0;
     if (permute) m->dst = drand48 () * n;
     else {
       double tmp = drand48 () * width;
@@ -360,13 +1629,13 @@ do {
 } while (0);
 #endif
 
-  int * res = malloc (n * sizeof *res);
+  int * res = huge_alloc (n * sizeof *res);
   if (!res) die ("out-of-memory allocating %d map", n);
 
   for (int i = 0; i < n; i++)
     res[i] = ranks[i].src;
 
-  free (ranks);
+  huge_free (ranks);
 
 #if 0
 do {
@@ -400,7 +1669,7 @@ do {
 static bool * flip () {
   srand48 (seed);
 
-  bool * res = malloc (max_var * sizeof *res);
+  bool * res = huge_alloc (max_var * sizeof *res);
        if (literal_flip_probability <= 0.0) memset (res, 0, max_var);
   else if (literal_flip_probability >= 1.0) memset (res, 1, max_var);
   else {
@@ -419,10 +1688,269 @@ static bool * flip () {
 
 /*------------------------------------------------------------------------*/
 
+// Same as 'rank' on variables but confined to quantifier blocks.  Each
+// block is ranked separately on the positions of its variables in the
+// prefix, with relative windows scaled by the size of the block.
+
+static int * rank_prefix () {
+
+  srand48 (seed);
+
+  Map * ranks = huge_alloc (max_var * sizeof *ranks);
+  if (!ranks) die ("out-of-memory allocating %d ranks", max_var);
+
+  for (int b = 0; b < num_blocks; b++) {
+    const Block * block = blocks + b;
+    for (int k = 0; k < block->size; k++) {
+      Map * m = ranks + block->start + k;
+      m->src = block->start + k;
+      m->group = b;
+      if (permute_variables) m->dst = drand48 () * block->size;
+      else {
+	double tmp = drand48 () * variable_move_window;
+	if (!absolute_windows) tmp *= block->size;
+	m->dst = k + tmp;
+      }
+    }
+  }
+
+  qsort (ranks, max_var, sizeof *ranks, cmp_rank);
+
+  int * res = huge_alloc (max_var * sizeof *res);
+  if (!res) die ("out-of-memory allocating %d map", max_var);
+
+  for (int i = 0; i < max_var; i++)
+    res[prefix[i]-1] = prefix[ranks[i].src] - 1;
+
+  huge_free (ranks);
+
+  return res;
+}
+
+/*------------------------------------------------------------------------*/
+
+// Reversing variables ('-r') is folded into 'variable_map' and 'flipped'
+// such that printing only needs to look up these two maps.  With a
+// quantifier prefix variables are only reversed within their block.
+
+static void reverse () {
+  int * reversed = malloc (max_var * sizeof *reversed);
+  if (!reversed) die ("out-of-memory allocating reversed map");
+  if (num_blocks) {
+    for (int b = 0; b < num_blocks; b++) {
+      const Block * block = blocks + b;
+      const int * vars = prefix + block->start;
+      for (int k = 0; k < block->size; k++)
+	reversed[vars[k]-1] = vars[block->size-1 - k] - 1;
+    }
+  } else {
+    for (int i = 0; i < max_var; i++)
+      reversed[i] = max_var-1 - i;
+  }
+  int * map = huge_alloc (max_var * sizeof *map);
+  bool * flips = huge_alloc (max_var * sizeof *flips);
+  if (!map || !flips) die ("out-of-memory allocating reversed maps");
+  for (int i = 0; i < max_var; i++) {
+    map[i] = variable_map[reversed[i]];
+    flips[i] = flipped[reversed[i]];
+  }
+  huge_free (variable_map);
+  huge_free (flipped);
+  free (reversed);
+  variable_map = map;
+  flipped = flips;
+}
+
+/*------------------------------------------------------------------------*/
+
+// Lazy variable map ('--lazy').  With move windows the destination of a
+// variable only depends on the random keys of variables within twice the
+// window width 'W' (rounded down plus two).  The keys are computed by a
+// counter-based generator from seed and variable, thus the map of a block
+// of positions '[lo,hi)' is obtained by ranking the keys in '[lo-2W,hi+2W)'
+// and keeping the middle.  Blocks are computed on first access and kept in
+// a small least-recently-used cache.  Flips are hashed in the same way.
+// This gives a different scramble than the default 'drand48' sequence.
+// Printing groups lookups by variable range (see 'print_blocked'), but
+// without any locality in the formula the cache still thrashes.  Thus if
+// more than 'LAZY_THRASHING' times the number of blocks of the whole map
+// have been computed, the map is materialized (with the same result).
+
+#define LAZY_BLOCKS 8
+#define LAZY_MIN_BLOCK (1 << 16)
+#define LAZY_THRASHING 2
+
+typedef struct Lazy { int block; uint64_t stamp; int * map; } Lazy;
+
+static Lazy lazy_cache[LAZY_BLOCKS];
+static Lazy * lazy_last;
+static Map * lazy_ranks;
+static double lazy_width;
+static int64_t lazy_margin;
+static int lazy_size;
+static uint64_t lazy_stamp, lazy_computed, lazy_limit;
+static bool lazy_mapping;               // Not materialized yet.
+
+static uint64_t splitmix64 (uint64_t x) {
+  x += 0x9e3779b97f4a7c15ull;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+  return x ^ (x >> 31);
+}
+
+static double lazy_uniform (uint64_t stream, int i) {
+  const uint64_t key = splitmix64 (seed ^ stream) + (uint64_t) i;
+  return (splitmix64 (key) >> 11) * 0x1.0p-53;
+}
+
+#define LAZY_KEYS 0x6b657973ull         // 'keys'
+#define LAZY_FLIPS 0x666c6970ull        // 'flip'
+
+static void init_lazy () {
+  if (num_blocks) die ("can not use '--lazy' with quantifier prefix");
+  lazy_width = variable_move_window;
+  if (!absolute_windows) lazy_width *= max_var;
+  lazy_margin = 2 * ((int64_t) lazy_width + 2);
+  int64_t size = 2 * lazy_margin;
+  if (size < LAZY_MIN_BLOCK) size = LAZY_MIN_BLOCK;
+  if (size > max_var) size = max_var ? max_var : 1;
+  lazy_size = size;
+  lazy_limit = LAZY_THRASHING * ((max_var + (int64_t) size - 1) / size);
+  int64_t ranks = lazy_size + 2 * lazy_margin;
+  if (ranks > max_var) ranks = max_var;
+  lazy_ranks = malloc (ranks * sizeof *lazy_ranks);
+  if (!lazy_ranks) die ("out-of-memory allocating lazy ranks");
+  for (int c = 0; c < LAZY_BLOCKS; c++) {
+    lazy_cache[c].block = -1;
+    lazy_cache[c].stamp = 0;
+    lazy_cache[c].map = malloc (lazy_size * sizeof *lazy_cache[c].map);
+    if (!lazy_cache[c].map) die ("out-of-memory allocating lazy map");
+  }
+  lazy_last = lazy_cache;
+  lazy_mapping = true;
+  msg ("lazy variable map with blocks of %d variables", lazy_size);
+}
+
+static void compute_lazy (Lazy * l, int block) {
+  const uint64_t begin = trace_begin ();
+  const int64_t lo = (int64_t) block * lazy_size;
+  int64_t hi = lo + lazy_size;
+  if (hi > max_var) hi = max_var;
+  const int64_t start = lo > lazy_margin ? lo - lazy_margin : 0;
+  const int64_t end =
+    hi + lazy_margin < max_var ? hi + lazy_margin : max_var;
+  const int n = end - start;
+  for (int k = 0; k < n; k++) {
+    Map * m = lazy_ranks + k;
+    m->src = start + k;
+    m->group = 0;
+    m->dst = m->src + lazy_uniform (LAZY_KEYS, m->src) * lazy_width;
+  }
+  qsort (lazy_ranks, n, sizeof *lazy_ranks, cmp_rank);
+  for (int64_t pos = lo; pos < hi; pos++)
+    l->map[pos - lo] = lazy_ranks[pos - start].src;
+  l->block = block;
+  lazy_computed++;
+  trace_end ("lazy block", begin);
+}
+
+static inline Lazy * lazy_block (int i) {
+  const int block = i / lazy_size;
+  Lazy * l = lazy_last;
+  if (l->block != block) {
+    Lazy * victim = lazy_cache;
+    for (l = lazy_cache; l < lazy_cache + LAZY_BLOCKS; l++)
+      if (l->block == block) break;
+      else if (l->stamp < victim->stamp) victim = l;
+    if (l == lazy_cache + LAZY_BLOCKS) compute_lazy (l = victim, block);
+    l->stamp = ++lazy_stamp;
+    lazy_last = l;
+  }
+  return l;
+}
+
+static void reset_lazy ();
+
+// Compute the complete map block by block and fold in '-r' and flips such
+// that the eager code in 'map_literal' is used from now on.
+
+static void materialize_lazy () {
+  msg ("lazy variable map thrashing after %" PRIu64 " blocks "
+       "(materializing it)", lazy_computed);
+  const uint64_t begin = trace_begin ();
+  variable_map = huge_alloc (max_var * sizeof *variable_map);
+  flipped = huge_alloc (max_var * sizeof *flipped);
+  if (!variable_map || !flipped)
+    die ("out-of-memory materializing lazy variable map");
+  for (int64_t lo = 0; lo < max_var; lo += lazy_size) {
+    compute_lazy (lazy_cache, lo / lazy_size);
+    const int64_t hi = lo + lazy_size < max_var ? lo + lazy_size : max_var;
+    memcpy (variable_map + lo, lazy_cache->map,
+      (hi - lo) * sizeof *variable_map);
+  }
+  for (int i = 0; i < max_var; i++)
+    flipped[i] = lazy_uniform (LAZY_FLIPS, i) < literal_flip_probability;
+  if (reverse_variables)
+    for (int i = 0, j = max_var-1; i < j; i++, j--) {
+      const int map = variable_map[i];
+      variable_map[i] = variable_map[j], variable_map[j] = map;
+      const bool flip = flipped[i];
+      flipped[i] = flipped[j], flipped[j] = flip;
+    }
+  reset_lazy ();
+  lazy_mapping = false;
+  trace_end ("materialize", begin);
+}
+
+static inline int map_literal (int);
+
+// Same as 'map_literal' below for lazy maps ('-r' is applied here).
+
+static int lazy_literal (int src) {
+  if (lazy_computed >= lazy_limit) {
+    materialize_lazy ();
+    return map_literal (src);
+  }
+  int i = abs (src) - 1;
+  if (reverse_variables) i = max_var-1 - i;
+  const Lazy * l = lazy_block (i);
+  const int dst = l->map[i - l->block * lazy_size] + 1;
+  const bool flip =
+    lazy_uniform (LAZY_FLIPS, i) < literal_flip_probability;
+  return (src < 0) ^ flip ? -dst : dst;
+}
+
+static void reset_lazy () {
+  for (int c = 0; c < LAZY_BLOCKS; c++)
+    free (lazy_cache[c].map), lazy_cache[c].map = 0;
+  free (lazy_ranks), lazy_ranks = 0;
+}
+
+/*------------------------------------------------------------------------*/
+
 static void scramble () {
-  variable_map = rank (max_var, permute_variables, variable_move_window);
-  clause_map = rank (num_clauses, permute_clauses, clause_move_window);
+  if (needed && num_clauses != range_clauses)
+    die ("'--range' needs exact clause count in header");
+  uint64_t begin = trace_begin ();
+  if (lazy) init_lazy ();
+  else if (num_blocks) variable_map = rank_prefix ();
+  else
+    variable_map = rank (max_var, permute_variables, variable_move_window);
+  trace_end ("rank variables", begin);
+  if (!clause_map) {
+    begin = trace_begin ();
+    clause_map = rank (num_clauses, permute_clauses, clause_move_window);
+    trace_end ("rank clauses", begin);
+  }
+  if (lazy) return;
+  begin = trace_begin ();
   flipped = flip ();
+  trace_end ("flip", begin);
+  if (reverse_variables) {
+    begin = trace_begin ();
+    reverse ();
+    trace_end ("reverse", begin);
+  }
 }
 
 /*------------------------------------------------------------------------*/
@@ -432,10 +1960,12 @@ static void banner (FILE * file,
   print (file, "Scranfilize CNF Scrambler");
   print (file, "Version %s %s", VERSION, GITID);
   print (file, "random seed '%ld'", seed);
+  if (input_hash[0]) print (file, "original GBD hash '%s'", input_hash);
   if (reverse_variables) print (file, "reverse all clauses ('-r')");
   if (reverse_clauses) print (file, "reverse all variables ('-R')");
   print (file, "literal flip probability %g ('-f %g')",
     literal_flip_probability, literal_flip_probability);
+  if (lazy) print (file, "lazy variable map ('--lazy')");
   if (permute_variables)
     print (file, "randomly permuting variables");
   else
@@ -466,12 +1996,744 @@ static void print_message (FILE *file, const char * msg, ...) {
   fputc ('\n', file);
 }
 
-static void print (const char * path) {
+/*------------------------------------------------------------------------*/
+
+// Buffered output.  Literals are formatted by hand instead of calling
+// 'fprintf' for each of them.  Optionally all buffered bytes are hashed
+// (64-bit FNV-1a) when flushed, which is used for the shard manifest.
+
+typedef struct Writer {
+  FILE * file;
+  const char * path;
+  char * buffer;
+  size_t size, capacity;
+  bool hashing;
+  uint64_t hash;
+  GBD * gbd;
+  uint64_t format_begin;
+  int fd;                       // Only set for page cache control.
+  bool direct, aligned;
+  size_t kept;                  // Bytes kept (and hashed) for direct I/O.
+  off_t started, synced;        // Write-behind positions.
+} Writer;
+
+#define DIRECT_BLOCK 4096
+
+static void
+init_writer (Writer * writer, FILE * file, const char * path) {
+  writer->file = file;
+  writer->path = path;
+  writer->capacity = write_buffer_size;
+  writer->fd = -1;
+  writer->direct = writer->aligned = false;
+  writer->kept = 0;
+  writer->started = writer->synced = 0;
+  struct stat buf;
+  if (file && (cache_window || direct_output) &&
+      !fstat (fileno (file), &buf) && S_ISREG (buf.st_mode)) {
+    writer->fd = fileno (file);
+    writer->direct = direct_output;
+  }
+  if (writer->direct) {
+    if (writer->capacity < 4 * DIRECT_BLOCK)
+      writer->capacity = 4 * DIRECT_BLOCK;
+    if (posix_memalign ((void **) &writer->buffer,
+                        DIRECT_BLOCK, writer->capacity))
+      writer->buffer = 0;
+  } else writer->buffer = malloc (writer->capacity);
+  if (!writer->buffer) die ("out-of-memory allocating output buffer");
+  writer->size = 0;
+  writer->hashing = false;
+  writer->gbd = 0;
+  writer->hash = 14695981039346656037ull;
+  writer->format_begin = trace_begin ();
+}
+
+static void write_all (Writer * writer, const char * p, size_t n) {
+  while (n) {
+    const ssize_t written = write (writer->fd, p, n);
+    if (written <= 0) die ("writing to '%s' failed", writer->path);
+    p += written, n -= written;
+  }
+}
+
+static bool set_direct (int fd, bool direct) {
+  int flags = fcntl (fd, F_GETFL);
+  if (flags < 0) return false;
+  flags = direct ? flags | O_DIRECT : flags & ~O_DIRECT;
+  return !fcntl (fd, F_SETFL, flags);
+}
+
+// Direct output ('--direct').  The header is written through 'stdio'.  The
+// first flush then writes just enough bytes to align the file offset and
+// enables 'O_DIRECT'.  Afterwards only whole blocks from the start of the
+// aligned buffer are written and the rest is kept for the next flush.
+// For the last flush 'O_DIRECT' is cleared to write the unaligned tail.
+
+static void write_direct (Writer * writer, bool last) {
+  size_t n = writer->size;
+  if (!writer->aligned && n) {
+    if (fflush (writer->file)) die ("writing to '%s' failed", writer->path);
+    const off_t offset = lseek (writer->fd, 0, SEEK_CUR);
+    size_t head = -offset & (DIRECT_BLOCK - 1);
+    if (head > n) head = n;
+    write_all (writer, writer->buffer, head);
+    memmove (writer->buffer, writer->buffer + head, n -= head);
+    if ((offset + head) & (DIRECT_BLOCK - 1)) ;
+    else if (set_direct (writer->fd, true)) writer->aligned = true;
+    else {
+      msg ("direct output to '%s' not supported", writer->path);
+      writer->direct = false;
+      write_all (writer, writer->buffer, n);
+      n = 0;
+    }
+  }
+  if (writer->aligned) {
+    const size_t bulk = n & ~(size_t) (DIRECT_BLOCK - 1);
+    write_all (writer, writer->buffer, bulk);
+    memmove (writer->buffer, writer->buffer + bulk, n -= bulk);
+    if (last && n) {
+      if (!set_direct (writer->fd, false))
+	die ("can not clear direct output to '%s'", writer->path);
+      writer->aligned = false;
+      write_all (writer, writer->buffer, n);
+      n = 0;
+    }
+  }
+  writer->size = writer->kept = n;
+}
+
+// Write-behind ('--cache-window <MB>').  Whenever half a window has been
+// written its write-back is started, and the previous half is waited for
+// and dropped from the page cache.  Thus at most a window of the output
+// is kept in the page cache.  The rest is dropped when the writer is
+// released.
+
+static void write_behind (Writer * writer, bool last) {
+  if (fflush (writer->file)) die ("writing to '%s' failed", writer->path);
+  const int fd = writer->fd;
+  const off_t end = lseek (fd, 0, SEEK_CUR);
+  if (last) {
+#ifdef SYNC_FILE_RANGE_WRITE
+    sync_file_range (fd, writer->synced, 0,
+      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+      SYNC_FILE_RANGE_WAIT_AFTER);
+#else
+    fdatasync (fd);
+#endif
+    posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);
+    writer->synced = writer->started = end;
+    return;
+  }
+  if (end < writer->started + (off_t) cache_window / 2) return;
+#ifdef SYNC_FILE_RANGE_WRITE
+  sync_file_range (fd, writer->started, end - writer->started,
+    SYNC_FILE_RANGE_WRITE);
+  if (writer->synced < writer->started) {
+    const off_t bytes = writer->started - writer->synced;
+    sync_file_range (fd, writer->synced, bytes,
+      SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+      SYNC_FILE_RANGE_WAIT_AFTER);
+    posix_fadvise (fd, writer->synced, bytes, POSIX_FADV_DONTNEED);
+  }
+#else
+  fdatasync (fd);
+  posix_fadvise (fd, writer->synced, end - writer->synced,
+    POSIX_FADV_DONTNEED);
+#endif
+  writer->synced = writer->started;
+  writer->started = end;
+}
+
+static void flush_writer (Writer * writer) {
+  trace_end ("format batch", writer->format_begin);
+  const uint64_t begin = trace_begin ();
+  const char * fresh = writer->buffer + writer->kept;
+  const size_t bytes = writer->size - writer->kept;
+  if (writer->hashing) {
+    uint64_t hash = writer->hash;
+    for (size_t i = 0; i < bytes; i++) {
+      hash ^= (unsigned char) fresh[i];
+      hash *= 1099511628211ull;
+    }
+    writer->hash = hash;
+  }
+  if (writer->gbd) gbd_update (writer->gbd, fresh, bytes);
+  if (writer->direct) write_direct (writer, false);
+  else {
+    if (writer->file && writer->size &&
+	fwrite (writer->buffer, writer->size, 1, writer->file) != 1)
+      die ("writing to '%s' failed", writer->path);
+    writer->size = 0;
+    if (writer->fd >= 0) write_behind (writer, false);
+  }
+  trace_end ("write", begin);
+  writer->format_begin = trace_begin ();
+}
+
+static void release_writer (Writer * writer) {
+  flush_writer (writer);
+  if (writer->direct) write_direct (writer, true);
+  else if (writer->fd >= 0) write_behind (writer, true);
+  free (writer->buffer);
+}
+
+// Make sure there is room for 'bytes' more bytes (at least 64).
+
+static inline void ensure (Writer * writer, size_t bytes) {
+  if (writer->size + bytes > writer->capacity) flush_writer (writer);
+}
+
+// Make sure there is room for at least one more literal or weight.
+
+static inline void reserve (Writer * writer) {
+  ensure (writer, 32);
+}
+
+static inline void write_char (Writer * writer, char ch) {
+  writer->buffer[writer->size++] = ch;
+}
+
+static inline void write_unsigned (Writer * writer, uint64_t u) {
+  char tmp[24], * p = tmp + sizeof tmp;
+  do *--p = '0' + u % 10; while (u /= 10);
+  const size_t len = tmp + sizeof tmp - p;
+  memcpy (writer->buffer + writer->size, p, len);
+  writer->size += len;
+}
+
+// Same as 'fprintf (file, "%d ", lit)' but without checking for room.
+// The sign is written unconditionally and only kept if negative.
+
+static inline void put_literal (Writer * writer, int lit) {
+  writer->buffer[writer->size] = '-';
+  writer->size += (lit < 0);
+  write_unsigned (writer, abs (lit));
+  write_char (writer, ' ');
+}
+
+static inline void write_literal (Writer * writer, int lit) {
+  reserve (writer);
+  put_literal (writer, lit);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Negating a literal of an XOR constraint toggles its parity.  Thus the
+// signs of the original literals and all flips are accumulated into a
+// single parity bit, which is printed as sign of the first literal.
+
+static void print_xor (Writer * writer, const int * clause) {
+  bool negate = false;
+  for (const int * p = clause; *p; p++)
+    negate ^= map_literal (*p) < 0;
+  reserve (writer);
+  write_char (writer, 'x');
+  for (const int * p = clause; *p; p++) {
+    int dst = abs (map_literal (*p));
+    assert (1 <= dst), assert (dst <= max_var);
+    if (p == clause && negate) dst = -dst;
+    write_literal (writer, dst);
+  }
+  reserve (writer);
+  write_char (writer, '0');
+  write_char (writer, '\n');
+}
+
+static int clause_at (int i) {
+  int j = clause_map[i];
+  if (reverse_clauses) j = num_clauses-1 - j;
+  assert (0 <= j), assert (j < num_clauses);
+  return j;
+}
+
+// Branch-free mapping of an original literal to a scrambled literal.
+
+static inline int map_literal (int src) {
+  if (lazy_mapping) return lazy_literal (src);
+  const int idx = abs (src);
+  assert (1 <= idx), assert (idx <= max_var);
+  const int dst = variable_map[idx-1] + 1;
+  assert (1 <= dst), assert (dst <= max_var);
+  const int negate = (src < 0) ^ flipped[idx-1];
+  return (dst ^ -negate) + negate;
+}
+
+// Specialized kernels for binary and ternary clauses, which reserve room
+// for the whole clause once (at most 12 bytes per literal).
+
+static inline void print_binary (Writer * writer, const int * c) {
+  const int a = map_literal (c[0]), b = map_literal (c[1]);
+  ensure (writer, 2 * 12 + 2);
+  put_literal (writer, a);
+  put_literal (writer, b);
+  write_char (writer, '0');
+  write_char (writer, '\n');
+}
+
+static inline void print_ternary (Writer * writer, const int * c) {
+  const int a = map_literal (c[0]), b = map_literal (c[1]);
+  const int d = map_literal (c[2]);
+  ensure (writer, 3 * 12 + 2);
+  put_literal (writer, a);
+  put_literal (writer, b);
+  put_literal (writer, d);
+  write_char (writer, '0');
+  write_char (writer, '\n');
+}
+
+static void print_long (Writer * writer, const int * clause) {
+  for (const int * p = clause; *p; p++)
+    write_literal (writer, map_literal (*p));
+  reserve (writer);
+  write_char (writer, '0');
+  write_char (writer, '\n');
+}
+
+// Pre-rendered literals ('--literal-table').  The text of the scrambled
+// literal (including the trailing space) of original literal 'lit' is
+// stored at 'text_offsets[k]' in 'literal_text' with 'k' being
+// '2*(abs(lit)-1) + (lit < 0)'.  Since each text has at most 12 bytes,
+// formatting is a fixed 16 byte copy and moving the end of the buffer.
+
+#define TEXT_SLACK 16
+
+static char * literal_text;
+static uint32_t * text_offsets;
+
+static inline void put_text (Writer * writer, int lit) {
+  const size_t k = 2 * (size_t) (abs (lit) - 1) + (lit < 0);
+  const uint32_t begin = text_offsets[k];
+  memcpy (writer->buffer + writer->size, literal_text + begin, TEXT_SLACK);
+  writer->size += text_offsets[k+1] - begin;
+}
+
+static void print_text (Writer * writer, Ref ref, const int * literals) {
+  switch (tag (ref)) {
+    case BINARY_CLAUSE:
+      ensure (writer, 2 * TEXT_SLACK + 2);
+      put_text (writer, literals[0]);
+      put_text (writer, literals[1]);
+      break;
+    case TERNARY_CLAUSE:
+      ensure (writer, 3 * TEXT_SLACK + 2);
+      put_text (writer, literals[0]);
+      put_text (writer, literals[1]);
+      put_text (writer, literals[2]);
+      break;
+    default:
+      for (const int * p = literals; *p; p++) {
+	ensure (writer, TEXT_SLACK + 2);
+	put_text (writer, *p);
+      }
+      ensure (writer, 2);
+      break;
+  }
+  write_char (writer, '0');
+  write_char (writer, '\n');
+}
+
+static void print_weight (Writer * writer, int j) {
+  reserve (writer);
+  if (weights[j]) write_unsigned (writer, weights[j]);
+  else write_char (writer, 'h');
+  write_char (writer, ' ');
+}
+
+static void print_clause (Writer * writer, int j) {
+  if (weighted) print_weight (writer, j);
+  const Ref ref = clauses[j];
+  const int * literals = clause_literals (ref);
+  if (literal_text && tag (ref) != XOR_CLAUSE) {
+    print_text (writer, ref, literals);
+    return;
+  }
+  switch (tag (ref)) {
+    case BINARY_CLAUSE: print_binary (writer, literals); break;
+    case TERNARY_CLAUSE: print_ternary (writer, literals); break;
+    case XOR_CLAUSE: print_xor (writer, literals); break;
+    default: print_long (writer, literals); break;
+  }
+}
+
+// Cache-blocked remapping ('--blocked-remap').  If the variable map and
+// flip bits are much larger than the caches, mapping literals in output
+// order misses the cache for almost every literal.  Instead the literals
+// of a batch of clauses are gathered, partitioned by variable range into
+// buckets of 'REMAP_BUCKET' variables, mapped bucket by bucket against a
+// cache resident slice of the maps and scattered back before formatting.
+
+#define REMAP_BATCH (1 << 18)           // Literals per batch.
+#define REMAP_BUCKET_LOG 15             // Variables per bucket (log).
+#define REMAP_VARIABLES (1 << 22)       // Automatic threshold.
+
+static int * remap_src, * remap_dst, * remap_order, * remap_count;
+static int remap_buckets;
+
+static inline int remap_bucket (int lit) {
+  return (abs (lit) - 1) >> REMAP_BUCKET_LOG;
+}
+
+static void remap_batch (int size) {
+  memset (remap_count, 0, (remap_buckets + 1) * sizeof *remap_count);
+  for (int k = 0; k < size; k++)
+    remap_count[remap_bucket (remap_src[k]) + 1]++;
+  for (int b = 1; b <= remap_buckets; b++)
+    remap_count[b] += remap_count[b-1];
+  for (int k = 0; k < size; k++)
+    remap_order[remap_count[remap_bucket (remap_src[k])]++] = k;
+  for (int k = 0; k < size; k++) {
+    const int pos = remap_order[k];
+    remap_dst[pos] = map_literal (remap_src[pos]);
+  }
+}
+
+static void print_blocked (Writer * writer, int begin, int end) {
+  if (!remap_src) {
+    remap_buckets = remap_bucket (max_var) + 1;
+    remap_src = malloc (REMAP_BATCH * sizeof *remap_src);
+    remap_dst = malloc (REMAP_BATCH * sizeof *remap_dst);
+    remap_order = malloc (REMAP_BATCH * sizeof *remap_order);
+    remap_count = malloc ((remap_buckets + 1) * sizeof *remap_count);
+    if (!remap_src || !remap_dst || !remap_order || !remap_count)
+      die ("out-of-memory allocating remapping batch");
+  }
+  int i = begin;
+  while (i < end) {
+    int last = i, size = 0;
+    while (last < end) {
+      const int j = clause_at (last);
+      const Ref ref = clauses[j];
+      if (tag (ref) != XOR_CLAUSE) {
+	const int n = clause_size (j);
+	if (size + n > REMAP_BATCH) break;
+	memcpy (remap_src + size, clause_literals (ref), n * sizeof (int));
+	size += n;
+      }
+      last++;
+    }
+    if (last == i) {                    // Clause larger than a batch.
+      print_clause (writer, clause_at (i++));
+      continue;
+    }
+    remap_batch (size);
+    const int * p = remap_dst;
+    while (i < last) {
+      const int j = clause_at (i++);
+      if (weighted) print_weight (writer, j);
+      const Ref ref = clauses[j];
+      if (tag (ref) == XOR_CLAUSE) {
+	print_xor (writer, clause_literals (ref));
+	continue;
+      }
+      const int * q = p + clause_size (j);
+      while (p < q) write_literal (writer, *p++);
+      reserve (writer);
+      write_char (writer, '0');
+      write_char (writer, '\n');
+    }
+  }
+}
+
+// Print the clauses at output positions 'begin' to 'end' (exclusive).
 
+static void print_clauses (Writer * writer, int begin, int end) {
+  if (blocked_remap > 0) {
+    print_blocked (writer, begin, end);
+    return;
+  }
+  for (int i = begin; i < end; i++)
+    print_clause (writer, clause_at (i));
+}
+
+// Banner, header line and quantifier prefix.
+
+static void print_header (Writer * writer) {
+  assert (!writer->size);
+  banner (writer->file, print_message);
+  char * line = writer->buffer;         // Buffered to be hashed too.
+  if (new_wcnf) ;
+  else if (weighted && top_weight)
+    writer->size = sprintf (line, "p wcnf %d %d %" PRIu64 "\n",
+      max_var, num_clauses, top_weight);
+  else
+    writer->size = sprintf (line, "p %s %d %d\n",
+      format (), max_var, num_clauses);
+  for (int b = 0; b < num_blocks; b++) {
+    const Block * block = blocks + b;
+    if (block->type == FREE) continue;
+    reserve (writer);
+    write_char (writer, block->type);
+    write_char (writer, ' ');
+    const int * vars = prefix + block->start;
+    for (int k = 0; k < block->size; k++)
+      write_literal (writer, variable_map[vars[k]-1] + 1);
+    reserve (writer);
+    write_char (writer, '0');
+    write_char (writer, '\n');
+  }
+}
+
+static void check_overwrite (const char * path) {
   if (path && exists (path)) {
     if (force) msg ("forced to overwrite existing '%s'", path);
     else die ("path '%s' exist (use '--force')", path);
   }
+}
+
+/*------------------------------------------------------------------------*/
+
+// Sharded output ('--shards <k>').  The clauses in output order are split
+// into 'k' consecutive ranges with about the same number of literals.
+// Each shard is written to '<scrambled-cnf>.<shard>' by a forked child
+// process, all running in parallel.  Concatenating the shards in order
+// gives a valid formula (the shard comments are legal anywhere).  The
+// manifest '<scrambled-cnf>.manifest' lists clause range, literals and
+// the FNV-1a hash of the non-comment bytes of each shard, which for the
+// first shard includes the header and the quantifier prefix.
+
+static char * shard_path (const char * path, const char * suffix) {
+  char * res = malloc (strlen (path) + strlen (suffix) + 2);
+  if (!res) die ("out-of-memory allocating shard path");
+  sprintf (res, "%s.%s", path, suffix);
+  return res;
+}
+
+static uint64_t
+print_shard (const char * path, int shard,
+             int begin, int end, uint64_t literals) {
+  FILE * file = fopen (path, "w");
+  if (!file) die ("can not write shard '%s'", path);
+  fprintf (file,
+    "c shard %d of %d with %d clauses at clause offset %d "
+    "and %" PRIu64 " literals\n",
+    shard, num_shards, end - begin, begin, literals);
+  Writer writer;
+  init_writer (&writer, file, path);
+  writer.hashing = true;
+  if (!shard) print_header (&writer);
+  print_clauses (&writer, begin, end);
+  release_writer (&writer);
+  if (fclose (file)) die ("closing shard '%s' failed", path);
+  return writer.hash;
+}
+
+// In sharded mode the parent process formats all clauses once more into
+// a writer without file to compute the GBD hash of the complete scrambled
+// CNF, which runs in parallel to the shard writers.
+
+static void hash_scrambled () {
+  GBD gbd;
+  gbd_init (&gbd);
+  Writer writer;
+  init_writer (&writer, 0, "<hash>");
+  writer.gbd = &gbd;
+  print_clauses (&writer, 0, num_clauses);
+  release_writer (&writer);
+  gbd_final (&gbd, scrambled_hash);
+}
+
+static uint64_t total_literals () {
+  uint64_t res = 0;
+  for (int j = 0; j < num_clauses; j++)
+    res += clause_size (j);
+  return res;
+}
+
+// Split the clauses in output order into 'parts' consecutive ranges
+// starting at 'first[part]' with about the same number of literals.
+
+static void partition (int parts, int * first, uint64_t * literals) {
+  const uint64_t total = total_literals ();
+  uint64_t sum = 0;
+  int part = 0;
+  first[0] = 0;
+  literals[0] = 0;
+  for (int i = 0; i < num_clauses; i++) {
+    while (part + 1 < parts && sum >= (part + 1) * total / parts)
+      first[++part] = i, literals[part] = 0;
+    const int size = clause_size (clause_at (i));
+    literals[part] += size;
+    sum += size;
+  }
+  while (part < parts) {
+    first[++part] = num_clauses;
+    if (part < parts) literals[part] = 0;
+  }
+}
+
+static void print_shards (const char * path) {
+
+  int * first = malloc ((num_shards + 1) * sizeof *first);
+  uint64_t * literals = calloc (num_shards, sizeof *literals);
+  if (!first || !literals) die ("out-of-memory allocating shards");
+
+  partition (num_shards, first, literals);
+
+  char ** paths = malloc (num_shards * sizeof *paths);
+  if (!paths) die ("out-of-memory allocating shard paths");
+  for (int s = 0; s < num_shards; s++) {
+    char suffix[16];
+    sprintf (suffix, "%d", s);
+    paths[s] = shard_path (path, suffix);
+    check_overwrite (paths[s]);
+  }
+  char * manifest = shard_path (path, "manifest");
+  check_overwrite (manifest);
+
+  uint64_t * hashes = mmap (0, num_shards * sizeof *hashes,
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (hashes == MAP_FAILED) die ("can not map shared shard hashes");
+
+  msg ("writing %d shards to '%s.<shard>' in parallel", num_shards, path);
+
+  fflush (stdout);
+  fflush (stderr);
+
+  pid_t * pids = malloc (num_shards * sizeof *pids);
+  if (!pids) die ("out-of-memory allocating process identifiers");
+  for (int s = 0; s < num_shards; s++) {
+    pid_t pid = fork ();
+    if (pid < 0) die ("can not fork shard writer %d", s);
+    if (!pid) {
+      trace_child (s);
+      hashes[s] = print_shard (paths[s], s,
+        first[s], first[s+1], literals[s]);
+      _exit (0);
+    }
+    pids[s] = pid;
+  }
+
+  if (gbd_hash) hash_scrambled ();
+
+  bool failed = false;
+  for (int s = 0; s < num_shards; s++) {
+    int status;
+    if (waitpid (pids[s], &status, 0) != pids[s] ||
+        !WIFEXITED (status) || WEXITSTATUS (status))
+      msg ("writing shard '%s' failed", paths[s]), failed = true;
+  }
+  if (failed) die ("writing shards failed");
+
+  FILE * file = fopen (manifest, "w");
+  if (!file) die ("can not write shard manifest '%s'", manifest);
+  fprintf (file, "c shard first-clause clauses literals fnv1a path\n");
+  for (int s = 0; s < num_shards; s++)
+    fprintf (file, "%d %d %d %" PRIu64 " %016" PRIx64 " %s\n",
+      s, first[s], first[s+1] - first[s], literals[s], hashes[s],
+      paths[s]);
+  if (fclose (file)) die ("closing shard manifest '%s' failed", manifest);
+  msg ("wrote shard manifest '%s'", manifest);
+
+  munmap (hashes, num_shards * sizeof *hashes);
+  for (int s = 0; s < num_shards; s++) free (paths[s]);
+  free (manifest);
+  free (paths);
+  free (pids);
+  free (literals);
+  free (first);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Seekable compressed output ('--frames <k>').  For '.zst', '.xz' and
+// '.gz' output the clauses are split into 'k' frames (balanced by
+// literals) and each frame is compressed independently by a separate
+// compressor process appending to the scrambled CNF.  Concatenated frames
+// are valid for all three formats.  The index '<scrambled-cnf>.index'
+// maps clause ranges of frames to their compressed offsets and is used
+// by 'open_frames' to decode in parallel.
+
+static const char * frame_encoder (const char * path) {
+  if (is_suffix (path, ".zst")) return "zstd -q -c -T%2$d >> '%1$s'";
+  if (is_suffix (path, ".xz")) return "xz -c -T%2$d >> '%1$s'";
+  if (is_suffix (path, ".gz"))
+    return has_program ("pigz") ? "pigz -c -p %2$d >> '%1$s'"
+                                : "gzip -c >> '%1$s'";
+  return 0;
+}
+
+static void print_frames (const char * path) {
+
+  int frames = num_frames;
+  if (frames > num_clauses && num_clauses) frames = num_clauses;
+
+  int * first = malloc ((frames + 1) * sizeof *first);
+  uint64_t * literals = malloc (frames * sizeof *literals);
+  uint64_t * offsets = malloc ((frames + 1) * sizeof *offsets);
+  if (!first || !literals || !offsets)
+    die ("out-of-memory allocating frames");
+
+  partition (frames, first, literals);
+
+  char * index = malloc (strlen (path) + 8);
+  if (!index) die ("out-of-memory allocating index path");
+  sprintf (index, "%s.index", path);
+  check_overwrite (index);
+
+  FILE * file = fopen (path, "w");
+  if (!file || fclose (file))
+    die ("can not write scrambled CNF '%s'", path);
+
+  msg ("writing %d compressed frames to '%s'", frames, path);
+
+  const char * fmt = frame_encoder (path);
+  char * cmd = malloc (strlen (fmt) + strlen (path) + 16);
+  if (!cmd) die ("out-of-memory allocating command string");
+  sprintf (cmd, fmt, path, processes ());
+
+  GBD gbd;
+  if (gbd_hash) gbd_init (&gbd);
+  offsets[0] = 0;
+  for (int f = 0; f < frames; f++) {
+    if (!(file = popen (cmd, "w"))) die ("can not run '%s'", cmd);
+    Writer writer;
+    init_writer (&writer, file, path);
+    if (!f) print_header (&writer);
+    if (gbd_hash) flush_writer (&writer), writer.gbd = &gbd;
+    print_clauses (&writer, first[f], first[f+1]);
+    release_writer (&writer);
+    if (pclose (file)) die ("compressing frame %d with '%s' failed", f, cmd);
+    struct stat buf;
+    if (stat (path, &buf)) die ("can not access '%s'", path);
+    offsets[f+1] = buf.st_size;
+  }
+  if (gbd_hash) gbd_final (&gbd, scrambled_hash);
+
+  if (!(file = fopen (index, "w")))
+    die ("can not write frame index '%s'", index);
+  fprintf (file, "c frame first-clause clauses offset bytes\n");
+  fprintf (file, "size %" PRIu64 " frames %d\n", offsets[frames], frames);
+  for (int f = 0; f < frames; f++)
+    fprintf (file, "%d %d %d %" PRIu64 " %" PRIu64 "\n",
+      f, first[f], first[f+1] - first[f],
+      offsets[f], offsets[f+1] - offsets[f]);
+  if (fclose (file)) die ("closing frame index '%s' failed", index);
+  msg ("wrote frame index '%s'", index);
+
+  free (cmd);
+  free (index);
+  free (offsets);
+  free (literals);
+  free (first);
+}
+
+/*------------------------------------------------------------------------*/
+
+static void print (const char * path) {
+
+  if (num_shards) {
+    print_shards (path);
+    return;
+  }
+
+  if (num_frames) {
+    check_overwrite (path);
+    print_frames (path);
+    return;
+  }
+
+  check_overwrite (path);
 
   FILE * file;
   int close_file;
@@ -488,31 +2750,579 @@ static void print (const char * path) {
 
   msg ("writing scrambled CNF to '%s'", path ? path : "<stdout>");
 
-  banner (file, print_message);
+  int begin = 0, end = num_clauses;
+  if (range_begin >= 0) begin = range_begin, end = range_end;
 
-  fprintf (file, "p cnf %d %d\n", max_var, num_clauses);
-  for (int i = 0; i < num_clauses; i++) {
-    int j = clause_map[i];
-    if (reverse_clauses) j = num_clauses-1 - j;
-    assert (0 <= j), assert (j < num_clauses);
-    for (const int * p = clauses[j]; *p; p++) {
-      const int src = *p;
-      int idx = abs (src);
-      if (reverse_variables) idx = max_var + 1 - idx;
-      assert (1 <= idx), assert (idx <= max_var);
-      int dst = variable_map[idx-1] + 1;
-      assert (1 <= dst), assert (dst <= max_var);
-      if (src < 0) dst = -dst;
-      if (flipped[idx-1]) dst = -dst;
-      fprintf (file, "%d ", dst);
-    }
-    fprintf (file, "0\n");
-  }
+  Writer writer;
+  init_writer (&writer, file, path);
+  if (!begin) print_header (&writer);
+  GBD gbd;                              // Without the header line.
+  if (gbd_hash) flush_writer (&writer), gbd_init (&gbd), writer.gbd = &gbd;
+  print_clauses (&writer, begin, end);
+  release_writer (&writer);
+  if (gbd_hash) gbd_final (&gbd, scrambled_hash);
 
   if (close_file == 1) fclose (file);
   if (close_file == 2) pclose (file);
 }
 
+
+/*------------------------------------------------------------------------*/
+
+// Dump the clause store and the scrambling maps as raw arrays in native
+// byte order ('--maps <prefix>'), such that they can be mapped without
+// copying or parsing, e.g., with 'numpy.memmap' in notebooks:
+//
+//   <prefix>.literals   int32   zero terminated clauses in input order
+//   <prefix>.clauses    int32   input clause of each output position
+//   <prefix>.variables  int32   output variable (0-based) of each variable
+//   <prefix>.flips      uint8   flipped flag of each variable
+//   <prefix>.weights    uint64  weight of each input clause (WCNF only)
+//   <prefix>.kinds      uint8   XOR flag of each input clause (XCNF only)
+//   <prefix>.prefix     int32   quantifier type ('a' or 'e') followed by
+//                               zero terminated variables of each block
+//                               in input variables (QDIMACS only)
+
+static void
+dump_array (const char * prefix, const char * name,
+            const void * data, size_t size, size_t count) {
+  char * path = malloc (strlen (prefix) + strlen (name) + 2);
+  if (!path) die ("out-of-memory allocating map path");
+  sprintf (path, "%s.%s", prefix, name);
+  check_overwrite (path);
+  FILE * file = fopen (path, "w");
+  if (!file) die ("can not write map '%s'", path);
+  if (count && fwrite (data, size, count, file) != count)
+    die ("writing map '%s' failed", path);
+  if (fclose (file)) die ("closing map '%s' failed", path);
+  free (path);
+}
+
+static void dump_maps (const char * base) {
+  FILE * file;
+  char * path = malloc (strlen (base) + 16);
+  if (!path) die ("out-of-memory allocating map path");
+  sprintf (path, "%s.literals", base);
+  check_overwrite (path);
+  if (!(file = fopen (path, "w"))) die ("can not write map '%s'", path);
+  const int zero = 0;
+  for (int j = 0; j < num_clauses; j++) {
+    const size_t size = clause_size (j);
+    if (fwrite (clause_literals (clauses[j]), sizeof (int), size, file)
+          != size || fwrite (&zero, sizeof zero, 1, file) != 1)
+      die ("writing map '%s' failed", path);
+  }
+  if (fclose (file)) die ("closing map '%s' failed", path);
+  free (path);
+  int * order = malloc (num_clauses * sizeof *order);
+  if (num_clauses && !order) die ("out-of-memory allocating clause order");
+  for (int i = 0; i < num_clauses; i++) order[i] = clause_at (i);
+  dump_array (base, "clauses", order, sizeof *order, num_clauses);
+  free (order);
+  dump_array (base, "variables",
+    variable_map, sizeof *variable_map, max_var);
+  dump_array (base, "flips", flipped, sizeof *flipped, max_var);
+  if (weighted)
+    dump_array (base, "weights", weights, sizeof *weights, num_clauses);
+  if (num_xors) {
+    unsigned char * kinds = malloc (num_clauses);
+    if (num_clauses && !kinds) die ("out-of-memory allocating clause kinds");
+    for (int j = 0; j < num_clauses; j++)
+      kinds[j] = (tag (clauses[j]) == XOR_CLAUSE);
+    dump_array (base, "kinds", kinds, 1, num_clauses);
+    free (kinds);
+  }
+  if (num_blocks) {
+    const size_t size = num_prefix + 2 * (size_t) num_blocks;
+    int * quantifiers = malloc (size * sizeof *quantifiers);
+    if (!quantifiers) die ("out-of-memory allocating quantifiers");
+    size_t count = 0;
+    for (int b = 0; b < num_blocks; b++) {
+      const Block * block = blocks + b;
+      if (block->type == FREE) continue;
+      quantifiers[count++] = block->type;
+      for (int k = 0; k < block->size; k++)
+	quantifiers[count++] = prefix[block->start + k];
+      quantifiers[count++] = 0;
+    }
+    dump_array (base, "prefix", quantifiers, sizeof *quantifiers, count);
+    free (quantifiers);
+  }
+  msg ("dumped clause store and maps to '%s.*'", base);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Host specific tuning ('--tune').  A synthetic CNF is written with and
+// read back through various buffer sizes in the directory of the
+// scrambled CNF (or '$TMPDIR').  This is done for a small and a large
+// input size class.  The fastest buffer sizes are saved in the profile
+// together with the number of processes for parallel stages.  Small
+// inputs always use a single process.  Later runs pick the size class
+// of their input and cap all parameters by the cgroup CPU and memory
+// limits of the current host.
+
+#define SMALL_INPUT (1u << 22)
+#define TUNE_SMALL (1u << 20)
+#define TUNE_LARGE (1u << 25)
+
+static const size_t buffer_sizes[] = {
+  1u << 12, 1u << 14, 1u << 16, 1u << 18, 1u << 20, 1u << 22
+};
+
+#define NUM_BUFFER_SIZES (sizeof buffer_sizes / sizeof *buffer_sizes)
+
+static const char * profile_path () {
+  static char path[4096];
+  const char * env = getenv ("SCRANFILIZE_PROFILE");
+  if (env) return env;
+  const char * home = getenv ("HOME");
+  if (!home) return 0;
+  snprintf (path, sizeof path, "%s/.scranfilize-profile", home);
+  return path;
+}
+
+static double seconds () {
+  return now () / 1e9;
+}
+
+// Write 'bytes' of synthetic clauses through a writer with the given
+// buffer size, including synchronization to the storage device.
+
+static double
+tune_write (const char * path, size_t bytes, size_t buffer_size) {
+  FILE * file = fopen (path, "w");
+  if (!file) die ("can not write tuning file '%s'", path);
+  setvbuf (file, 0, _IONBF, 0);
+  write_buffer_size = buffer_size;
+  const double start = seconds ();
+  Writer writer;
+  init_writer (&writer, file, path);
+  uint64_t state = 1;
+  size_t written = 0;
+  while (written < bytes) {
+    reserve (&writer);
+    const size_t before = writer.size;
+    state = state * 6364136223846793005ull + 1442695040888963407ull;
+    write_literal (&writer, (int) (state >> 44) - (1 << 19));
+    written += writer.size - before;
+  }
+  release_writer (&writer);
+  fflush (file);
+  fsync (fileno (file));
+  fclose (file);
+  return seconds () - start;
+}
+
+static double tune_read (const char * path, size_t buffer_size) {
+  FILE * file = fopen (path, "r");
+  if (!file) die ("can not read tuning file '%s'", path);
+  setvbuf (file, 0, _IOFBF, buffer_size);
+  const int fd = fileno (file);
+  fsync (fd);                           // Measure reading from the device
+  posix_fadvise (fd, 0, 0, POSIX_FADV_DONTNEED);  // not the page cache.
+  const double start = seconds ();
+  uint64_t sum = 0;
+  int ch;
+  while ((ch = getc_unlocked (file)) != EOF) sum += ch;
+  fclose (file);
+  const double res = seconds () - start;
+  if (!sum) msg ("empty tuning file '%s'", path);
+  return res;
+}
+
+static size_t fastest (double * times) {
+  size_t res = 0;
+  for (size_t i = 1; i < NUM_BUFFER_SIZES; i++)
+    if (times[i] < times[res]) res = i;
+  return buffer_sizes[res];
+}
+
+static void
+tune_size (const char * path, size_t bytes, size_t * read, size_t * write) {
+  double read_times[NUM_BUFFER_SIZES], write_times[NUM_BUFFER_SIZES];
+  for (size_t i = 0; i < NUM_BUFFER_SIZES; i++)
+    read_times[i] = write_times[i] = 1e300;
+  for (int round = 0; round < 3; round++)
+    for (size_t i = 0; i < NUM_BUFFER_SIZES; i++) {
+      if (i && buffer_sizes[i] > bytes) break;
+      double t = tune_write (path, bytes, buffer_sizes[i]);
+      if (t < write_times[i]) write_times[i] = t;
+      t = tune_read (path, buffer_sizes[i]);
+      if (t < read_times[i]) read_times[i] = t;
+    }
+  *read = fastest (read_times);
+  *write = fastest (write_times);
+  msg ("tuned %zu bytes: read buffer %zu, write buffer %zu",
+    bytes, *read, *write);
+}
+
+static void tune_host (const char * scrambled) {
+  const char * profile = profile_path ();
+  if (!profile) die ("can not determine profile path (set '$HOME')");
+  char dir[4096];
+  const char * tmp = getenv ("TMPDIR");
+  if (scrambled) {
+    snprintf (dir, sizeof dir, "%s", scrambled);
+    char * slash = strrchr (dir, '/');
+    if (slash) *slash = 0; else strcpy (dir, ".");
+  } else snprintf (dir, sizeof dir, "%s", tmp ? tmp : "/tmp");
+  char path[4200];
+  snprintf (path, sizeof path, "%s/scranfilize-tune-%d.cnf",
+    dir, (int) getpid ());
+  msg ("tuning with temporary file '%s'", path);
+  size_t small_read, small_write, large_read, large_write;
+  tune_size (path, TUNE_SMALL, &small_read, &small_write);
+  tune_size (path, TUNE_LARGE, &large_read, &large_write);
+  unlink (path);
+  const int cpus = cgroup_cpus ();
+  FILE * file = fopen (profile, "w");
+  if (!file) die ("can not write profile '%s'", profile);
+  fprintf (file, "c input-bytes read-buffer write-buffer processes\n");
+  fprintf (file, "%u %zu %zu 1\n", SMALL_INPUT, small_read, small_write);
+  fprintf (file, "max %zu %zu %d\n", large_read, large_write, cpus);
+  if (fclose (file)) die ("closing profile '%s' failed", profile);
+  msg ("wrote profile '%s'", profile);
+}
+
+// Estimated uncompressed size of the original CNF, if it is a file.
+
+static uint64_t input_size (const char * path) {
+  struct stat buf;
+  if (!path || stat (path, &buf)) return UINT64_MAX;
+  uint64_t res = buf.st_size;
+  if (is_suffix (path, ".xz") || is_suffix (path, ".lzma") ||
+      is_suffix (path, ".bz2") || is_suffix (path, ".gz") ||
+      is_suffix (path, ".7z"))
+    res *= 8;
+  return res;
+}
+
+static void load_profile (const char * original) {
+  const char * profile = profile_path ();
+  if (!profile) return;
+  FILE * file = fopen (profile, "r");
+  if (!file) return;
+  const uint64_t size = input_size (original);
+  char line[256];
+  bool found = false;
+  while (!found && fgets (line, sizeof line, file)) {
+    if (line[0] == 'c') continue;
+    char bound[32];
+    size_t read, write;
+    int processes;
+    if (sscanf (line, "%31s %zu %zu %d",
+                bound, &read, &write, &processes) != 4 ||
+        !read || !write || processes < 1)
+      die ("invalid line in profile '%s' (rerun '--tune')", profile);
+    if (strcmp (bound, "max") && size > strtoull (bound, 0, 10))
+      continue;
+    read_buffer_size = read;
+    write_buffer_size = write;
+    max_processes = processes;
+    found = true;
+  }
+  fclose (file);
+  if (!found) {
+    msg ("profile '%s' has no entry for %" PRIu64 " input bytes",
+      profile, size);
+    return;
+  }
+  const int cpus = cgroup_cpus ();
+  if (max_processes > cpus) max_processes = cpus;
+  const uint64_t memory = cgroup_memory ();
+  if (memory) {
+    const uint64_t limit = memory / 64;
+    if (read_buffer_size > limit) read_buffer_size = limit;
+    if (write_buffer_size > limit) write_buffer_size = limit;
+    if (write_buffer_size < 64) write_buffer_size = 64;
+  }
+  msg ("loaded profile '%s' (ignore with '--no-profile')", profile);
+  msg ("profile read buffer %zu, write buffer %zu, %d process%s",
+    read_buffer_size, write_buffer_size,
+    max_processes, max_processes == 1 ? "" : "es");
+}
+
+/*------------------------------------------------------------------------*/
+
+// Render the text of all scrambled literals once (see 'put_text').  This
+// pays off if literals occur often on average and the table is small
+// enough, i.e., at most 1 GB and an eighth of the cgroup memory limit.
+// Text offsets have 32 bits, which only a forced table can exceed.
+
+#define TABLE_OCCURRENCES 16
+#define TABLE_LIMIT (1ull << 30)
+
+static void render_literals () {
+  if (!literal_table || !max_var) return;
+  const uint64_t literals = num_binaries + num_ternaries + num_arena;
+  const uint64_t bytes = 2ull * max_var * (12 + sizeof *text_offsets);
+  if (literal_table < 0) {
+    if (literals < TABLE_OCCURRENCES * (uint64_t) max_var) return;
+    const uint64_t memory = cgroup_memory ();
+    if (bytes > TABLE_LIMIT || (memory && bytes > memory / 8)) return;
+  }
+  const uint64_t begin = trace_begin ();
+  const size_t entries = 2 * (size_t) max_var;
+  text_offsets = malloc ((entries + 1) * sizeof *text_offsets);
+  literal_text = malloc (12 * entries + TEXT_SLACK);
+  if (!text_offsets || !literal_text)
+    die ("out-of-memory allocating literal table");
+  Writer writer;
+  writer.buffer = literal_text;
+  writer.size = 0;
+  for (int idx = 1; idx <= max_var; idx++) {
+    if (writer.size > UINT32_MAX - 24)
+      die ("literal table exceeds 32-bit text offsets "
+           "(try '--no-literal-table')");
+    text_offsets[2*(idx-1)] = writer.size;
+    put_literal (&writer, map_literal (idx));
+    text_offsets[2*(idx-1) + 1] = writer.size;
+    put_literal (&writer, map_literal (-idx));
+  }
+  text_offsets[entries] = writer.size;
+  memset (literal_text + writer.size, 0, TEXT_SLACK);
+  trace_end ("render literals", begin);
+  msg ("rendered %zu bytes of text for %zu literals", writer.size, entries);
+}
+
+// Pre-rendered literals already avoid mapping while printing, otherwise
+// map literals in blocks if the maps do not fit into the caches.
+
+static void select_remap () {
+  if (literal_text) {
+    if (blocked_remap > 0) msg ("pre-rendered literals need no remapping");
+    blocked_remap = 0;
+  } else if (blocked_remap < 0)
+    blocked_remap = lazy || max_var > REMAP_VARIABLES;
+  if (blocked_remap)
+    msg ("mapping literals in blocks of %d variables", 1 << REMAP_BUCKET_LOG);
+}
+
+/*------------------------------------------------------------------------*/
+
+// Seed search ('--search <cmd>').  The CNF is parsed once.  Then for each
+// of '--seeds <n>' consecutive seeds a forked child scrambles it and pipes
+// the scrambled CNF to the solver command '<cmd>' (reading from '<stdin>')
+// and measures the wall clock time until the solver exits.  Up to
+// 'processes ()' children run in parallel.  Each child leads its own
+// process group, such that the solver can be killed on timeout.  Since
+// timings are noisy, the fastest and slowest seeds are run once more and
+// their average time is used.  Only runs where the solver exits with
+// code 0, 10 or 20 (unknown, satisfiable, unsatisfiable) count, such that
+// a solver failing quickly on some scrambles does not make them the
+// fastest ones.  Finally the fastest and slowest scramble are written to
+// '<scrambled-cnf>.fastest' and '<scrambled-cnf>.slowest', and all runs
+// are listed in '<scrambled-cnf>.seeds'.
+
+#define SEARCH_CONFIRM 2                // Extreme seeds on each side.
+
+enum { TRIAL_TIMEOUT = -1, TRIAL_FAILED = -2 };
+
+typedef struct Trial {
+  long seed;
+  pid_t pid;
+  uint64_t start;
+  double time;                          // Seconds.
+  int status;                           // Solver exit code or negative.
+  int run;
+} Trial;
+
+static void release_scramble () {
+  huge_free (variable_map), variable_map = 0;
+  huge_free (clause_map), clause_map = 0;
+  huge_free (flipped), flipped = 0;
+  if (lazy) reset_lazy ();
+}
+
+static void run_trial (Trial * trial) {
+  setpgid (0, 0);
+  signal (SIGPIPE, SIG_IGN);
+  ring = 0;
+  seed = trial->seed;
+  scramble ();
+  FILE * file = popen (search_command, "w");
+  if (!file) die ("can not run '%s'", search_command);
+  const uint64_t begin = now ();
+  Writer writer;
+  init_writer (&writer, file, search_command);
+  print_header (&writer);
+  print_clauses (&writer, 0, num_clauses);
+  release_writer (&writer);
+  const int status = pclose (file);
+  trial->time = (now () - begin) * 1e-9;
+  trial->status =
+    WIFEXITED (status) ? WEXITSTATUS (status) : TRIAL_FAILED;
+  if (trial->status != 0 && trial->status != 10 && trial->status != 20) {
+    if (trial->status != TRIAL_FAILED)
+      msg ("seed %ld run %d: solver failed with exit code %d",
+        trial->seed, trial->run, trial->status);
+    trial->status = TRIAL_FAILED;
+  }
+  _exit (0);
+}
+
+static const char * trial_status (const Trial * trial) {
+  static char buffer[16];
+  if (trial->status == TRIAL_TIMEOUT) return "timeout";
+  if (trial->status == TRIAL_FAILED) return "failed";
+  sprintf (buffer, "%d", trial->status);
+  return buffer;
+}
+
+static void run_trials (Trial * trials, int n) {
+  const int jobs = processes ();
+  int started = 0, running = 0;
+  while (started < n || running) {
+    while (started < n && running < jobs) {
+      Trial * trial = trials + started++;
+      trial->status = TRIAL_FAILED;
+      fflush (stdout);
+      fflush (stderr);
+      const pid_t pid = fork ();
+      if (pid < 0) die ("can not fork search process");
+      if (!pid) run_trial (trial);
+      setpgid (pid, pid);
+      trial->pid = pid;
+      trial->start = now ();
+      running++;
+    }
+    int status;
+    const pid_t pid = waitpid (-1, &status, WNOHANG);
+    if (pid < 0) die ("waiting for search processes failed");
+    if (pid > 0) {
+      Trial * trial = trials;
+      while (trial->pid != pid) trial++;
+      trial->pid = 0;
+      running--;
+      if (trial->status == TRIAL_TIMEOUT) trial->time = search_timeout;
+      else if (!WIFEXITED (status) || WEXITSTATUS (status))
+	trial->status = TRIAL_FAILED;
+      msg ("seed %ld run %d: %s after %.2f seconds",
+        trial->seed, trial->run, trial_status (trial), trial->time);
+      continue;
+    }
+    const uint64_t limit = search_timeout * 1e9;
+    for (Trial * trial = trials; trial < trials + started; trial++)
+      if (trial->pid && trial->status != TRIAL_TIMEOUT &&
+          now () - trial->start > limit) {
+	kill (-trial->pid, SIGKILL);
+	trial->status = TRIAL_TIMEOUT;
+      }
+    const struct timespec delay = { 0, 10000000 };
+    nanosleep (&delay, 0);
+  }
+}
+
+static int cmp_trial (const void * p, const void * q) {
+  const Trial * r = *(Trial **) p, * s = *(Trial **) q;
+  if (r->time < s->time) return -1;
+  if (r->time > s->time) return 1;
+  return (r->seed > s->seed) - (r->seed < s->seed);
+}
+
+// Average time over all successful runs of the seed of 'trial'.
+
+static double
+average_time (const Trial * trials, int n, const Trial * trial) {
+  double sum = 0;
+  int runs = 0;
+  for (int i = 0; i < n; i++)
+    if (trials[i].seed == trial->seed &&
+        trials[i].status != TRIAL_FAILED)
+      sum += trials[i].time, runs++;
+  return sum / runs;
+}
+
+static void write_scramble (const char * path, long s) {
+  seed = s;
+  scramble ();
+  print (path);
+  release_scramble ();
+}
+
+static void search_seeds (const char * path) {
+
+  if (!path) die ("'--search' requires '<scrambled-cnf>'");
+  char * fastest = shard_path (path, "fastest");
+  char * slowest = shard_path (path, "slowest");
+  char * table = shard_path (path, "seeds");
+  check_overwrite (fastest);
+  check_overwrite (slowest);
+  check_overwrite (table);
+
+  select_remap ();
+
+  const int size = num_seeds + 2 * SEARCH_CONFIRM;
+  Trial * trials = mmap (0, size * sizeof *trials,
+    PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (trials == MAP_FAILED) die ("can not map shared search trials");
+  Trial ** sorted = malloc (num_seeds * sizeof *sorted);
+  if (!sorted) die ("out-of-memory allocating search trials");
+
+  msg ("searching %d seeds starting at %ld with '%s'",
+    num_seeds, seed, search_command);
+  const long first = seed;
+  for (int i = 0; i < num_seeds; i++)
+    trials[i].seed = first + i, trials[i].run = 1;
+  run_trials (trials, num_seeds);
+
+  int solved = 0;
+  for (int i = 0; i < num_seeds; i++)
+    if (trials[i].status != TRIAL_FAILED)
+      sorted[solved++] = trials + i;
+  if (!solved) die ("solver '%s' failed on all seeds", search_command);
+  qsort (sorted, solved, sizeof *sorted, cmp_trial);
+
+  int confirm = 0;
+  for (int i = 0; i < solved; i++)
+    if (i < SEARCH_CONFIRM || i >= solved - SEARCH_CONFIRM) {
+      Trial * trial = trials + num_seeds + confirm++;
+      trial->seed = sorted[i]->seed;
+      trial->run = 2;
+    }
+  msg ("confirming %d extreme seeds", confirm);
+  run_trials (trials + num_seeds, confirm);
+
+  const int all = num_seeds + confirm;
+  const Trial * best = 0, * worst = 0;
+  double best_time = 0, worst_time = 0;
+  for (const Trial * trial = trials + num_seeds;
+       trial < trials + all; trial++) {
+    if (trial->status == TRIAL_FAILED) continue;
+    const double time = average_time (trials, all, trial);
+    if (!best || time < best_time) best = trial, best_time = time;
+    if (!worst || time > worst_time) worst = trial, worst_time = time;
+  }
+  if (!best) die ("solver '%s' failed on all extreme seeds", search_command);
+
+  FILE * file = fopen (table, "w");
+  if (!file) die ("can not write seed table '%s'", table);
+  fprintf (file, "c seed run seconds status\n");
+  for (const Trial * trial = trials; trial < trials + all; trial++)
+    fprintf (file, "%ld %d %.3f %s\n",
+      trial->seed, trial->run, trial->time, trial_status (trial));
+  fprintf (file, "c fastest seed %ld average %.3f seconds\n",
+    best->seed, best_time);
+  fprintf (file, "c slowest seed %ld average %.3f seconds\n",
+    worst->seed, worst_time);
+  if (fclose (file)) die ("closing seed table '%s' failed", table);
+  msg ("wrote seed table '%s'", table);
+
+  msg ("fastest seed %ld with average %.2f seconds",
+    best->seed, best_time);
+  msg ("slowest seed %ld with average %.2f seconds",
+    worst->seed, worst_time);
+  write_scramble (fastest, best->seed);
+  write_scramble (slowest, worst->seed);
+
+  munmap (trials, size * sizeof *trials);
+  free (sorted);
+  free (table);
+  free (slowest);
+  free (fastest);
+}
+
 /*------------------------------------------------------------------------*/
 // Files.
 
@@ -569,6 +3379,59 @@ static void init (int argc, char ** argv) {
       clause_move_window = tmp;
     } else if (!strcmp (argv[i], "-a")) absolute_windows = true;
     else if (!strcmp (argv[i], "--force")) force = true;
+    else if (!strcmp (argv[i], "--shards")) {
+      if (++i == argc) die ("argument to '--shards' missing");
+      num_shards = atoi (argv[i]);
+      if (num_shards <= 0)
+	die ("invalid argument in '--shards %s'", argv[i]);
+    } else if (!strcmp (argv[i], "--cache-window")) {
+      if (++i == argc) die ("argument to '--cache-window' missing");
+      const long megabytes = atol (argv[i]);
+      if (megabytes <= 0)
+	die ("invalid argument in '--cache-window %s'", argv[i]);
+      cache_window = (size_t) megabytes << 20;
+    } else if (!strcmp (argv[i], "--search")) {
+      if (++i == argc) die ("argument to '--search' missing");
+      search_command = argv[i];
+    } else if (!strcmp (argv[i], "--seeds")) {
+      if (++i == argc) die ("argument to '--seeds' missing");
+      num_seeds = atoi (argv[i]);
+      if (num_seeds <= 0)
+	die ("invalid argument in '--seeds %s'", argv[i]);
+    } else if (!strcmp (argv[i], "--timeout")) {
+      if (++i == argc) die ("argument to '--timeout' missing");
+      search_timeout = atof (argv[i]);
+      if (!(search_timeout > 0))
+	die ("invalid argument in '--timeout %s'", argv[i]);
+    } else if (!strcmp (argv[i], "--direct")) direct_output = true;
+    else if (!strcmp (argv[i], "--range")) {
+      if (++i == argc) die ("argument to '--range' missing");
+      if (sscanf (argv[i], "%d:%d", &range_begin, &range_end) != 2 ||
+          range_begin < 0 || range_end < range_begin)
+	die ("invalid argument in '--range %s'", argv[i]);
+    } else if (!strcmp (argv[i], "--frames")) {
+      if (++i == argc) die ("argument to '--frames' missing");
+      num_frames = atoi (argv[i]);
+      if (num_frames <= 0)
+	die ("invalid argument in '--frames %s'", argv[i]);
+    } else if (!strcmp (argv[i], "--trace")) {
+      if (++i == argc) die ("argument to '--trace' missing");
+      trace_path = argv[i];
+    } else if (!strcmp (argv[i], "--maps")) {
+      if (++i == argc) die ("argument to '--maps' missing");
+      maps_prefix = argv[i];
+    } else if (!strcmp (argv[i], "--tune")) tune = true;
+    else if (!strcmp (argv[i], "--gbd-hash")) gbd_hash = true;
+    else if (!strcmp (argv[i], "--literal-table")) literal_table = 1;
+    else if (!strcmp (argv[i], "--no-literal-table")) literal_table = 0;
+    else if (!strcmp (argv[i], "--blocked-remap")) blocked_remap = 1;
+    else if (!strcmp (argv[i], "--no-blocked-remap")) blocked_remap = 0;
+    else if (!strcmp (argv[i], "--lazy")) lazy = true;
+    else if (!strcmp (argv[i], "--hugetlb")) huge_pages = 2;
+    else if (!strcmp (argv[i], "--no-huge-pages")) huge_pages = 0;
+    else if (!strcmp (argv[i], "--no-profile")) use_profile = false;
+    else if (!strcmp (argv[i], "--trust-input")) trust_input = true;
+    else if (!strcmp (argv[i], "--no-validate")) validate = false;
     else if (argv[i][0] == '-')
       die ("invalid option '%s' (try '-h')", argv[i]);
     else if (scrambled)
@@ -578,6 +3441,11 @@ static void init (int argc, char ** argv) {
     else original = argv[i];
   }
 
+  // Only the directory of the scrambled CNF is used by '--tune', which
+  // thus also takes a single path as '<scrambled-cnf>'.
+
+  if (tune && original && !scrambled) scrambled = original, original = 0;
+
   if (permute_variables) {
     if (reverse_variables) die ("can not combine '-p' and '-r'");
     if (variable_move_window >=0) die ("can not combine '-p' and '-v'");
@@ -590,6 +3458,44 @@ static void init (int argc, char ** argv) {
     if (absolute_windows) die ("can not combine '-P' and '-a'");
   }
 
+  if (lazy) {
+    if (permute_variables) die ("can not combine '--lazy' and '-p'");
+    if (maps_prefix) die ("can not combine '--lazy' and '--maps'");
+    if (literal_table > 0)
+      die ("can not combine '--lazy' and '--literal-table'");
+    literal_table = 0;
+  }
+
+  if (search_command) {
+    if (range_begin >= 0) die ("can not combine '--search' and '--range'");
+    if (num_shards) die ("can not combine '--search' and '--shards'");
+    if (maps_prefix) die ("can not combine '--search' and '--maps'");
+    if (gbd_hash) die ("can not combine '--search' and '--gbd-hash'");
+  }
+
+  if (range_begin >= 0) {
+    if (num_shards) die ("can not combine '--range' and '--shards'");
+    if (num_frames) die ("can not write '--range' output to frames");
+    if (seed < 0) die ("'--range' requires an explicit seed '-s <seed>'");
+    if (maps_prefix) die ("can not combine '--range' and '--maps'");
+    if (gbd_hash) die ("can not combine '--range' and '--gbd-hash'");
+  }
+
+  if (num_frames) {
+    if (!scrambled || !frame_encoder (scrambled))
+      die ("'--frames' requires '.zst', '.xz' or '.gz' <scrambled-cnf>");
+    if (num_shards) die ("can not combine '--frames' and '--shards'");
+  }
+
+  if (num_shards && !scrambled)
+    die ("'--shards' requires '<scrambled-cnf>'");
+
+  if (trace_path) init_trace (1 + num_shards);
+  if (gbd_hash) gbd_init (&input_gbd);
+
+  if (!validate && !trust_input)
+    die ("can not use '--no-validate' without '--trust-input'");
+
   if (seed < 0) {
     struct tms buffer;
     uint64_t t = 8526563 * (unsigned long) times (&buffer);
@@ -605,26 +3511,55 @@ static void init (int argc, char ** argv) {
   if (variable_move_window < 0) variable_move_window = default_window;
   if (clause_move_window < 0) clause_move_window = default_window;
 
-  banner (stdout, print_message);
+  if (range_begin <= 0) banner (stdout, print_message);
 }
 
 /*------------------------------------------------------------------------*/
 
 void reset () {
-  free (flipped);
-  free (clause_map);
-  free (variable_map);
-  for (int i = 0; i < num_clauses; i++) free (clauses[i]);
-  free (clauses);
+  huge_free (flipped);
+  huge_free (clause_map);
+  huge_free (variable_map);
+  huge_free (binaries);
+  huge_free (ternaries);
+  huge_free (arena);
+  huge_free (clauses);
+  huge_free (weights);
+  free (blocks);
+  free (prefix);
+  free (literal_text);
+  free (text_offsets);
+  free (remap_src);
+  free (remap_dst);
+  free (remap_order);
+  free (remap_count);
+  free (needed);
+  if (lazy) reset_lazy ();
 }
 
 /*------------------------------------------------------------------------*/
 
 int main (int argc, char ** argv) {
   init (argc, argv);
+  if (tune) {
+    tune_host (scrambled);
+    return 0;
+  }
+  if (use_profile) load_profile (original);
   parse (original);
-  scramble ();
-  print (scrambled);
+  if (search_command) search_seeds (scrambled);
+  else {
+    scramble ();
+    if (maps_prefix) dump_maps (maps_prefix);
+    render_literals ();
+    select_remap ();
+    print (scrambled);
+    if (lazy) msg ("computed %" PRIu64 " lazy variable map blocks",
+                lazy_computed);
+    if (gbd_hash) msg ("scrambled GBD hash '%s'", scrambled_hash);
+  }
+  huge_stats ();
+  dump_trace ();
   reset ();
   return 0;
 }
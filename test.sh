@@ -1,13 +1,152 @@
 #!/bin/sh
 
+SCRANFILIZE_PROFILE=log/profile
+export SCRANFILIZE_PROFILE
+
 execute () {
-  input=cnfs/${1}.cnf
-  output=log/${1}-$2.cnf
-  log=log/${1}-$2.log
-  cmd="./scranfilize -s 0 $3 $input $output"
-  echo "$cmd"
-  $cmd 2>$log && return
-  cat $log
+  case $1 in
+    *.*) input=cnfs/$1; base=`echo $1|sed -e 's,\.[^.]*$,,'`; ext=`echo $1|sed -e 's,.*\.,,'`;;
+    *) input=cnfs/${1}.cnf; base=$1; ext=cnf;;
+  esac
+  output=log/${base}-$2.$ext
+  log=log/${base}-$2.log
+  check "./scranfilize -s 0 $3 $input $output" $log
+}
+
+# Check that the output of the last 'execute' (or its shards) is the same
+# as the default scrambling after removing comments matching '$1'.
+
+agree () {
+  default=log/${base}-default.$ext
+  files=$output; [ -f $output ] || files=`ls $output.[0-9]*`
+  grep -hv "${1:-^$}" $files | cmp -s - $default && return
+  echo "'$output' differs from '$default'"
+  exit 1
+}
+
+check () {
+  echo "$1"
+  $1 2>$2 && return
+  cat $2
+  exit 1
+}
+
+frames () {
+  framed=log/add16-framed.cnf.$1
+  check "./scranfilize -s 0 --frames 3 cnfs/add16.cnf $framed" $framed.log
+  check "./scranfilize -s 0 $framed log/add16-reframed-$1.cnf" $framed.log
+}
+
+ranges () {
+  sliced=log/add16-sliced
+  check "./scranfilize -s 0 cnfs/add16.cnf $sliced.cnf" $sliced.log
+  check "./scranfilize -s 0 --range 0:50 cnfs/add16.cnf $sliced-0.cnf" $sliced.log
+  check "./scranfilize -s 0 --range 50:1000 cnfs/add16.cnf $sliced-1.cnf" $sliced.log
+  cat $sliced-0.cnf $sliced-1.cnf | cmp -s - $sliced.cnf && return
+  echo "concatenated ranges differ from '$sliced.cnf'"
+  exit 1
+}
+
+search () {
+  searched=log/add8-searched.cnf
+  echo "./scranfilize -s 0 --seeds 3 --search cksum cnfs/add8.cnf $searched"
+  ./scranfilize -s 0 --seeds 3 --search cksum cnfs/add8.cnf $searched \
+    >/dev/null 2>$searched.log || { cat $searched.log; exit 1; }
+  [ -f $searched.fastest -a -f $searched.slowest ] && return
+  echo "missing fastest or slowest scramble of '$searched'"
+  exit 1
+}
+
+# The expected hashes are computed by GBD's own hashing algorithm on
+# 'cnfs/add16.cnf' and on the scrambled CNF with seed '0'.
+
+gbd () {
+  hashed=log/add16-hashed.cnf
+  check "./scranfilize -s 0 --gbd-hash cnfs/add16.cnf $hashed" $hashed.log
+  grep -q "original GBD hash '27098d2276cf349909dbc9da0e12b449'" $hashed.log &&
+  grep -q "scrambled GBD hash 'cbf685262b4ab234be1923748298992e'" $hashed.log &&
+  return
+  echo "unexpected GBD hashes in '$hashed.log'"
+  exit 1
+}
+
+# Without flipping and moving the scrambled CNF has to have the original
+# clauses, which in 'lengths.cnf' cover every kind of stored clause.
+
+lengths () {
+  execute lengths identity "-f 0 -v 0 -c 0"
+  grep -v '^c' $output | cmp -s - $input && return
+  echo "'$output' differs from '$input'"
+  exit 1
+}
+
+thrashing () {
+  thrashed=log/random-thrashed.cnf
+  check "./scranfilize -s 0 --lazy -a -v 3 --no-blocked-remap cnfs/random.cnf $thrashed" $thrashed.log
+  grep -q "lazy variable map thrashing" $thrashed.log &&
+  cmp -s log/random-lazy.cnf $thrashed && return
+  echo "materialized lazy map of '$thrashed' differs"
+  exit 1
+}
+
+words () {
+  [ -f $1 ] && od -An -v -t$2 $1 | awk '{ for (i = 1; i <= NF; i++) print t, $i }' t=$3
+}
+
+rebuild () {
+  case $1 in
+    *.*) base=`echo $1|sed -e 's,\.[^.]*$,,'`; ext=`echo $1|sed -e 's,.*\.,,'`;;
+    *) base=$1; ext=cnf;;
+  esac
+  maps=log/$1-maps
+  echo "rebuilding 'log/$base-maps.$ext' from '$maps.*'"
+  {
+    words $maps.variables d4 v
+    words $maps.flips u1 f
+    words $maps.kinds u1 k
+    words $maps.prefix d4 q
+    words $maps.literals d4 l
+    words $maps.clauses d4 c
+  } | awk '
+    BEGIN { start[0] = 0 }
+    $1 == "v" { var[nv++] = $2 + 1 }
+    $1 == "f" { flip[nf++] = $2 }
+    $1 == "k" { kind[nk++] = $2 }
+    $1 == "q" { quantifiers[nq++] = $2 }
+    $1 == "l" { if ($2) lit[nl++] = $2; else start[++nc] = nl }
+    $1 == "c" { order[no++] = $2 }
+    END {
+      print "p cnf " nv " " nc
+      for (i = 0; i < nq; i++) {
+        line = quantifiers[i] == 97 ? "a" : "e"
+        while (quantifiers[++i]) line = line " " var[quantifiers[i] - 1]
+        print line " 0"
+      }
+      for (i = 0; i < no; i++) {
+        j = order[i]; line = kind[j] ? "x" : ""; negate = 0
+        for (k = start[j]; k < start[j + 1]; k++) {
+          idx = lit[k] < 0 ? -lit[k] : lit[k]
+          sign = (lit[k] < 0) != flip[idx - 1]
+          if (kind[j]) negate = negate != sign
+          dst[k - start[j]] = sign && !kind[j] ? -var[idx - 1] : var[idx - 1]
+        }
+        if (negate) dst[0] = -dst[0]
+        for (k = 0; k < start[j + 1] - start[j]; k++) line = line dst[k] " "
+        print line "0"
+      }
+    }' > $maps.rebuilt
+  grep -v '^c' log/$base-maps.$ext | cmp -s - $maps.rebuilt && return
+  echo "rebuilt '$maps.rebuilt' differs from 'log/$base-maps.$ext'"
+  exit 1
+}
+
+tune () {
+  tuned=log/add4-tuned.cnf
+  check "./scranfilize --tune $tuned" log/tune.log
+  check "./scranfilize -s 0 cnfs/add4.cnf $tuned" $tuned.log
+  grep -q "loaded profile '$SCRANFILIZE_PROFILE'" $tuned.log &&
+  cmp -s log/add4-default.cnf $tuned && return
+  echo "scrambling with profile '$SCRANFILIZE_PROFILE' failed"
   exit 1
 }
 
@@ -25,6 +164,16 @@ run () {
   execute $1 reverse-variables -r
   execute $1 reverse-clauses -R
   execute $1 reverse-variables-and-clauses "-r -R"
+  execute $1 trusted --trust-input; agree
+  execute $1 sharded "--shards 3"; agree "^c shard"
+  execute $1 traced "--trace log/$1-trace.json"
+  execute $1 maps "--maps log/$1-maps"
+  execute $1 literal-table --literal-table; agree
+  execute $1 blocked-remap --blocked-remap; agree
+  execute $1 hugetlb --hugetlb; agree
+  execute $1 cache-window "--cache-window 1 --direct"; agree
+  case $1 in *.qdimacs) ;; *) execute $1 lazy "--lazy -a -v 3";; esac
+  case $1 in *.*) ;; *) execute $1 gbd-hash --gbd-hash; agree '^c original';; esac
 }
 
 [ -d log ] || mkdir log
@@ -34,3 +183,19 @@ run add4
 run add8
 run add16
 run add32
+run weighted.wcnf
+run quantified.qdimacs
+run parity.xcnf
+run random
+run lengths
+frames gz
+frames xz
+ranges
+search
+gbd
+lengths
+rebuild add16
+rebuild quantified.qdimacs
+rebuild parity.xcnf
+thrashing
+tune